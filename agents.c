@@ -0,0 +1,214 @@
+#include <stdlib.h>
+
+#include <SDL2/SDL.h>
+
+#include "game.h"
+#include "agents.h"
+
+// Must be a power of two so the ageing pass can mask instead of divide.
+#define AGENT_YEAR_LENGTH 4096
+
+#define AGENT_MAX_AGE 255
+
+static void init_day_schedule(unsigned char *day_schedule)
+{
+	for (int t = 0; t < AGENT_DAY_LENGTH; t++) {
+		int hour = t * 24 / AGENT_DAY_LENGTH;
+		if (hour == 8 || hour == 17) {
+			day_schedule[t] = AGENT_COMMUTING;
+		} else if (hour > 8 && hour < 17) {
+			day_schedule[t] = AGENT_WORKING;
+		} else {
+			day_schedule[t] = AGENT_HOME;
+		}
+	}
+}
+
+int init_agents(struct agents *a, int capacity, int max_houses)
+{
+	*a = (struct agents){ 0 };
+	a->age = calloc(capacity, sizeof(*a->age));
+	a->state = calloc(capacity, sizeof(*a->state));
+	a->home = calloc(capacity, sizeof(*a->home));
+	a->workplace = calloc(capacity, sizeof(*a->workplace));
+	a->next = calloc(capacity, sizeof(*a->next));
+	a->migrants = calloc(capacity, sizeof(*a->migrants));
+	a->unemployed = calloc(capacity, sizeof(*a->unemployed));
+	a->house_head = malloc(max_houses * sizeof(*a->house_head));
+	if (!a->age || !a->state || !a->home ||
+	    !a->workplace || !a->next || !a->migrants ||
+	    !a->unemployed || !a->house_head) {
+		SDL_Log("Failed to allocate %d agents", capacity);
+		return -1;
+	}
+	for (int i = 0; i < max_houses; i++) {
+		a->house_head[i] = -1;
+	}
+	a->free_head = -1;
+	a->capacity = capacity;
+	init_day_schedule(a->day_schedule);
+	return 0;
+}
+
+void destroy_agents(struct agents *a)
+{
+	free(a->age);
+	free(a->state);
+	free(a->home);
+	free(a->workplace);
+	free(a->next);
+	free(a->migrants);
+	free(a->unemployed);
+	free(a->house_head);
+	*a = (struct agents){ 0 };
+}
+
+static int alloc_agent(struct agents *a)
+{
+	if (a->free_head >= 0) {
+		int id = a->free_head;
+		a->free_head = a->next[id];
+		return id;
+	}
+	if (a->high_water < a->capacity) {
+		return a->high_water++;
+	}
+	return -1;
+}
+
+static void free_agent(struct agents *a, int id)
+{
+	a->state[id] = AGENT_FREE;
+	a->home[id] = -1;
+	a->next[id] = a->free_head;
+	a->free_head = id;
+	a->count--;
+}
+
+static void link_agent(struct agents *a, int id, int house)
+{
+	a->home[id] = house;
+	a->next[id] = a->house_head[house];
+	a->house_head[house] = id;
+}
+
+void agents_spawn(struct agents *a, int house, enum agent_state state, int age)
+{
+	if (!a->capacity) {
+		return;
+	}
+	int id = alloc_agent(a);
+	if (id < 0) {
+		return;
+	}
+	a->age[id] = age;
+	a->state[id] = state;
+	a->workplace[id] = -1;
+	link_agent(a, id, house);
+	a->count++;
+	if (state != AGENT_CHILD) {
+		a->unemployed[a->num_unemployed++] = id;
+	}
+}
+
+// The oldest child is the one to move out.
+void agents_leave(struct agents *a, int house)
+{
+	if (!a->capacity) {
+		return;
+	}
+	int *oldest = 0;
+	for (int *link = &a->house_head[house]; *link >= 0;
+	     link = &a->next[*link]) {
+		if (a->state[*link] == AGENT_CHILD &&
+		    (!oldest || a->age[*link] > a->age[*oldest])) {
+			oldest = link;
+		}
+	}
+	if (!oldest) {
+		return;
+	}
+	int id = *oldest;
+	*oldest = a->next[id];
+	a->home[id] = -1;
+	a->state[id] = AGENT_MIGRATING;
+	a->migrants[a->num_migrants++] = id;
+}
+
+void agents_arrive(struct agents *a, int house)
+{
+	if (!a->capacity || a->num_migrants == 0) {
+		return;
+	}
+	int id = a->migrants[--a->num_migrants];
+	// Settling in a house of their own makes them an adult.
+	if (a->age[id] < AGENT_ADULT_AGE) {
+		a->age[id] = AGENT_ADULT_AGE;
+	}
+	a->state[id] = AGENT_HOME;
+	link_agent(a, id, house);
+	a->unemployed[a->num_unemployed++] = id;
+}
+
+void agents_emigrate(struct agents *a)
+{
+	for (int i = 0; i < a->num_migrants; i++) {
+		free_agent(a, a->migrants[i]);
+	}
+	a->num_migrants = 0;
+}
+
+void agents_employ(struct agents *a, int workplace)
+{
+	if (!a->capacity || a->num_unemployed == 0) {
+		return;
+	}
+	int id = a->unemployed[--a->num_unemployed];
+	a->workplace[id] = workplace;
+}
+
+/*
+ * The passes below touch every slot up to the high water mark with
+ * straight-line selects instead of per-agent branches, so the compiler can
+ * vectorize them; free and migrating slots are masked out rather than
+ * skipped.
+ */
+SIMD_KERNEL static void age_agents(struct agents *a)
+{
+	unsigned char *restrict age = a->age;
+	const unsigned char *restrict state = a->state;
+	int n = a->high_water;
+	for (int i = 0; i < n; i++) {
+		int alive = state[i] != AGENT_FREE;
+		int room = age[i] < AGENT_MAX_AGE;
+		age[i] += alive & room;
+	}
+}
+
+SIMD_KERNEL static void commute_agents(struct agents *a, int tick)
+{
+	unsigned char *restrict state = a->state;
+	const int *restrict workplace = a->workplace;
+	int n = a->high_water;
+	for (int i = 0; i < n; i++) {
+		// Stagger residents across the day so they don't all move on
+		// the same tick.
+		unsigned char s = a->day_schedule[(tick + i) &
+						  (AGENT_DAY_LENGTH - 1)];
+		int adult = state[i] >= AGENT_HOME &&
+			    state[i] <= AGENT_WORKING;
+		int employed = workplace[i] >= 0;
+		state[i] = adult && employed ? s : state[i];
+	}
+}
+
+void agents_update(struct agents *a, int tick)
+{
+	if (!a->capacity) {
+		return;
+	}
+	if ((tick & (AGENT_YEAR_LENGTH - 1)) == 0) {
+		age_agents(a);
+	}
+	commute_agents(a, tick);
+}
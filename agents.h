@@ -0,0 +1,55 @@
+#ifndef _AGENTS_H
+#define _AGENTS_H
+
+// Must be a power of two so the commute pass can mask instead of divide.
+#define AGENT_DAY_LENGTH 256
+
+// The age adults are spawned at, and the youngest a child can be once it
+// has moved out and become one.
+#define AGENT_ADULT_AGE 30
+
+enum agent_state {
+	AGENT_FREE,
+	AGENT_CHILD,
+	AGENT_HOME,
+	AGENT_COMMUTING,
+	AGENT_WORKING,
+	AGENT_MIGRATING,
+};
+
+/*
+ * Optional per-resident layer mirroring the adults/children counts kept in
+ * each house. Residents live in a structure-of-arrays table whose index is
+ * the agent id, costing 22 bytes per slot plus 4 per house (10M agents
+ * fit in ~220MB).
+ * All hooks are no-ops until init_agents() has been called.
+ */
+struct agents {
+	int capacity;
+	int count;
+	int high_water;
+	unsigned char *age;
+	unsigned char *state;
+	int *home;
+	int *workplace;
+	int *next;
+	int *house_head;
+	int free_head;
+	int *migrants;
+	int num_migrants;
+	int *unemployed;
+	int num_unemployed;
+	unsigned char day_schedule[AGENT_DAY_LENGTH];
+};
+
+extern int init_agents(struct agents *a, int capacity, int max_houses);
+extern void destroy_agents(struct agents *a);
+extern void agents_spawn(struct agents *a, int house, enum agent_state state,
+			 int age);
+extern void agents_leave(struct agents *a, int house);
+extern void agents_arrive(struct agents *a, int house);
+extern void agents_emigrate(struct agents *a);
+extern void agents_employ(struct agents *a, int workplace);
+extern void agents_update(struct agents *a, int tick);
+
+#endif
@@ -0,0 +1,108 @@
+#include <SDL2/SDL.h>
+
+#include "batch.h"
+#include "pool.h"
+#include "simulate.h"
+
+#define BATCH_HISTOGRAM_BUCKETS 16
+#define BATCH_HISTOGRAM_WIDTH 250
+
+struct batch_stats {
+	SDL_SpinLock lock;
+	int completed;
+	int population_min;
+	int population_max;
+	double population_sum;
+	double population_sum_squares;
+	long long emigration_sum;
+	int emigration_histogram[BATCH_HISTOGRAM_BUCKETS];
+};
+
+struct batch {
+	const struct batch_options *options;
+	struct batch_stats stats;
+};
+
+// Results are folded in as each city finishes, so the stats are always
+// current and no per-instance results are kept.
+static void record_instance(struct batch_stats *s, int population,
+			    long long emigration)
+{
+	int bucket = emigration / BATCH_HISTOGRAM_WIDTH;
+	if (bucket >= BATCH_HISTOGRAM_BUCKETS) {
+		bucket = BATCH_HISTOGRAM_BUCKETS - 1;
+	}
+	SDL_AtomicLock(&s->lock);
+	if (s->completed == 0 || population < s->population_min) {
+		s->population_min = population;
+	}
+	if (s->completed == 0 || population > s->population_max) {
+		s->population_max = population;
+	}
+	s->population_sum += population;
+	s->population_sum_squares += (double)population * population;
+	s->emigration_sum += emigration;
+	s->emigration_histogram[bucket]++;
+	s->completed++;
+	SDL_AtomicUnlock(&s->lock);
+}
+
+static void run_instance(void *data, int index)
+{
+	struct batch *b = data;
+	const struct batch_options *o = b->options;
+	int options = o->agents ? WORLD_AGENTS : 0;
+	struct world *w = create_world(o->seed + index, options);
+	if (!w) {
+		return;
+	}
+	long long emigration = 0;
+	for (int t = 0; t < o->ticks; t++) {
+		simulate(w);
+		emigration += w->emigration;
+	}
+	record_instance(&b->stats, w->population, emigration);
+	destroy_world(w);
+}
+
+static void print_stats(const struct batch_stats *s)
+{
+	double n = s->completed;
+	double mean = n > 0 ? s->population_sum / n : 0;
+	double variance = n > 0 ? s->population_sum_squares / n - mean * mean
+				: 0;
+	printf("instances: %d\n", s->completed);
+	printf("population mean: %.2f\n", mean);
+	printf("population stddev: %.2f\n", sqrt(variance > 0 ? variance : 0));
+	printf("population min: %d\n", s->population_min);
+	printf("population max: %d\n", s->population_max);
+	printf("emigration mean: %.2f\n", n > 0 ? s->emigration_sum / n : 0);
+	printf("emigration histogram:\n");
+	for (int i = 0; i < BATCH_HISTOGRAM_BUCKETS; i++) {
+		int lo = i * BATCH_HISTOGRAM_WIDTH;
+		if (i == BATCH_HISTOGRAM_BUCKETS - 1) {
+			printf("  %5d+     : %d\n", lo,
+			       s->emigration_histogram[i]);
+		} else {
+			printf("  %5d-%-5d: %d\n", lo,
+			       lo + BATCH_HISTOGRAM_WIDTH - 1,
+			       s->emigration_histogram[i]);
+		}
+	}
+}
+
+int run_batch(const struct batch_options *o)
+{
+	struct batch b = { .options = o };
+	Uint64 start = SDL_GetPerformanceCounter();
+	if (pool_run(o->threads, o->instances, run_instance, &b) < 0) {
+		return -1;
+	}
+	double seconds = (double)(SDL_GetPerformanceCounter() - start) /
+			 SDL_GetPerformanceFrequency();
+	print_stats(&b.stats);
+	printf("ticks per second: %.0f\n",
+	       seconds > 0 ? (double)o->ticks * b.stats.completed / seconds
+			   : 0);
+	return b.stats.completed == o->instances ? 0 : -1;
+}
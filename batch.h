@@ -0,0 +1,14 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+
+struct batch_options {
+	int instances;
+	int ticks;
+	int threads;
+	unsigned long long seed;
+	int agents;
+};
+
+extern int run_batch(const struct batch_options *o);
+
+#endif
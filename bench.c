@@ -0,0 +1,301 @@
+/*
+ * Benchmarks for the simulation and rendering hot paths. The simulation
+ * and renderer sources are included directly so their static functions
+ * can be timed in isolation. The grid size is fixed at compile time, so
+ * `make bench` builds one binary per size; each prints one JSON object
+ * per measurement on stdout, and the results are collected as JSON Lines.
+ */
+#include "simulate.c"
+#include "render.c"
+
+#define BENCH_MIN_SECONDS 0.2
+#define BENCH_MAX_ITERATIONS 1000000
+
+SDL_Window *window = 0;
+SDL_Renderer *renderer = 0;
+
+static struct world *world = 0;
+
+typedef void (*bench_function)(int param);
+
+struct bench {
+	const char *name;
+	const char *param_name;
+	bench_function setup;
+	bench_function run;
+	int params[4];
+	int num_params;
+	size_t (*memory)(int param);
+};
+
+static void reset_world()
+{
+	if (world) {
+		destroy_world(world);
+	}
+	world = create_world(0, WORLD_EMPTY);
+	if (!world) {
+		exit(1);
+	}
+}
+
+static void setup_houses(int count)
+{
+	reset_world();
+	for (int i = 0; i < count; i++) {
+		int x = random_int(world, GRID_WIDTH);
+		int y = random_int(world, GRID_HEIGHT);
+		if (world->grid[y][x].type != TILE_GRASS) {
+			continue;
+		}
+		int index = build_tile(world, x, y, TILE_HOUSE);
+		struct house *h = &world->houses[index];
+		h->adults = 1 + random_int(world, 2);
+		h->children = random_int(world, 3);
+		world->num_adults += h->adults;
+		world->population += h->adults + h->children;
+		house_changed(world, index);
+	}
+}
+
+static void setup_roads(int count)
+{
+	reset_world();
+	for (int i = 0; i < count; i++) {
+		place_random_road(world);
+	}
+}
+
+static void run_simulate(int param)
+{
+	simulate(world);
+}
+
+// Lots wait on a wheel keyed by tick, so the clock has to move for any
+// of them to come up.
+static void run_develop_lots(int param)
+{
+	world->tick++;
+	develop_lots(world);
+}
+
+// One step of every field. Fields only step every fourth tick, so a tick
+// pays a quarter of this on average.
+static void run_update_fields(int param)
+{
+	update_fields(&world->fields, 0);
+}
+
+static void run_place_houses_along_road(int param)
+{
+	place_houses_along_road(world);
+}
+
+/*
+ * The agent table is sized explicitly rather than from the grid, so the
+ * per-agent cost can be measured at populations far beyond what a bench
+ * map holds. Every agent is an employed adult, the worst case for the
+ * commute pass.
+ */
+static struct agents bench_agents = { 0 };
+static int bench_tick = 0;
+
+static void setup_agents(int count)
+{
+	destroy_agents(&bench_agents);
+	if (init_agents(&bench_agents, count, MAX_BUILDINGS) < 0) {
+		exit(1);
+	}
+	for (int i = 0; i < count; i++) {
+		agents_spawn(&bench_agents, i % MAX_BUILDINGS, AGENT_HOME,
+			     AGENT_ADULT_AGE);
+		agents_employ(&bench_agents, i % MAX_BUILDINGS);
+	}
+}
+
+static size_t agents_memory(int count)
+{
+	size_t per_agent = sizeof(*bench_agents.age) +
+		sizeof(*bench_agents.state) + sizeof(*bench_agents.home) +
+		sizeof(*bench_agents.workplace) + sizeof(*bench_agents.next) +
+		sizeof(*bench_agents.migrants) +
+		sizeof(*bench_agents.unemployed);
+	return count * per_agent +
+		(size_t)MAX_BUILDINGS * sizeof(*bench_agents.house_head);
+}
+
+static void run_agents_update(int param)
+{
+	agents_update(&bench_agents, bench_tick++);
+}
+
+static void run_update_rendering_tile(int param)
+{
+	rendering_grid[0][0].needs_update = RENDER_ALL_LEVELS;
+	update_rendering_tile(world, 0, 0, 0);
+}
+
+static struct menu_entry bench_menu_entries[] = {
+	{ "Population: 000000", 0 },
+	{ "Option B",           0 },
+	{ "Option C",           0 },
+};
+
+static struct menu bench_menu = {
+	.x = 10,
+	.y = 10,
+	.entries = bench_menu_entries,
+	.num_entries = 3,
+	.font_size = 2,
+	.border_size = 2,
+	.padding = 2,
+	.background = { 255, 255, 255, 255 },
+	.foreground = { 255,   0,   0, 255 },
+	.border =     {   0,   0,   0, 255 },
+};
+
+static void run_compile_menu(int param)
+{
+	struct compiled_menu cm = { 0 };
+	hud.num_quads = 0;
+	compile_menu(&cm, &bench_menu);
+}
+
+static void run_write_text(int param)
+{
+	static const SDL_Color color = { 255, 0, 0, 255 };
+	hud.num_quads = 0;
+	write_text(0, 0, "The quick brown fox jumps over the lazy dog", 2,
+		   color);
+}
+
+static float bench_graph_values[POPULATION_RETENTION] = { 0 };
+
+static struct graph bench_graph = {
+	.x = 10,
+	.y = 100,
+	.w = 300,
+	.h = 100,
+	.values = bench_graph_values,
+};
+
+static void setup_graph(int count)
+{
+	srand(1);
+	for (int i = 0; i < count; i++) {
+		bench_graph_values[i] = rand() % 1000;
+	}
+	bench_graph.num_values = count;
+}
+
+static void run_draw_graph_data(int param)
+{
+	hud.num_quads = 0;
+	draw_graph_data(&bench_graph);
+}
+
+static const struct bench simulation_benches[] = {
+	{ "simulate", "houses", setup_houses, run_simulate,
+	  { 16, (MAX_BUILDINGS) / 8, (MAX_BUILDINGS) / 2 }, 3 },
+	{ "develop_lots", "roads", setup_roads, run_develop_lots,
+	  { 1, 8 }, 2 },
+	{ "update_fields", "roads", setup_roads, run_update_fields,
+	  { 8 }, 1 },
+	{ "place_houses_along_road", "roads", setup_roads,
+	  run_place_houses_along_road, { 1, 8 }, 2 },
+	{ "agents_update", "agents", setup_agents, run_agents_update,
+	  { 1 << 16, 1 << 20, 10000000 }, 3, agents_memory },
+};
+
+static const struct bench render_benches[] = {
+	{ "update_rendering_tile", 0, 0, run_update_rendering_tile,
+	  { 0 }, 1 },
+	{ "compile_menu", 0, 0, run_compile_menu, { 0 }, 1 },
+	{ "write_text", 0, 0, run_write_text, { 0 }, 1 },
+	{ "draw_graph_data", "values", setup_graph, run_draw_graph_data,
+	  { 8, POPULATION_RETENTION }, 2 },
+};
+
+static double seconds(Uint64 ticks)
+{
+	return (double)ticks / SDL_GetPerformanceFrequency();
+}
+
+// Setup runs once per parameter, so benches whose run mutates the world
+// are timed from that state onwards; place_houses_along_road and
+// develop_lots therefore settle into their steady-state cost.
+static void run_bench(const struct bench *b)
+{
+	for (int p = 0; p < b->num_params; p++) {
+		int param = b->params[p];
+		if (b->setup) {
+			b->setup(param);
+		}
+		long iterations = 0;
+		Uint64 start = SDL_GetPerformanceCounter();
+		Uint64 elapsed = 0;
+		while (seconds(elapsed) < BENCH_MIN_SECONDS &&
+		       iterations < BENCH_MAX_ITERATIONS) {
+			for (int i = 0; i < 16; i++) {
+				b->run(param);
+			}
+			iterations += 16;
+			elapsed = SDL_GetPerformanceCounter() - start;
+		}
+		printf("{\"bench\": \"%s\", \"grid_width\": %d, "
+		       "\"grid_height\": %d", b->name, GRID_WIDTH, GRID_HEIGHT);
+		if (b->param_name) {
+			printf(", \"%s\": %d", b->param_name, param);
+		}
+		if (b->memory) {
+			printf(", \"bytes\": %zu", b->memory(param));
+		}
+		printf(", \"iterations\": %ld, \"ns_per_op\": %.1f}\n",
+		       iterations, seconds(elapsed) * 1e9 / iterations);
+	}
+}
+
+static int init_offscreen_renderer()
+{
+	SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+		SDL_Log("Failed to initialise SDL: %s", SDL_GetError());
+		return -1;
+	}
+	SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(
+		0, WINDOW_WIDTH, WINDOW_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+	if (!surface) {
+		SDL_Log("Failed to create bench surface: %s", SDL_GetError());
+		return -1;
+	}
+	renderer = SDL_CreateSoftwareRenderer(surface);
+	if (!renderer) {
+		SDL_Log("Failed to create renderer: %s", SDL_GetError());
+		return -1;
+	}
+	return init_render();
+}
+
+int main(int argc, char **argv)
+{
+	// Past one tile per window pixel a cell is drawn zero pixels wide or
+	// high, so at those sizes only the simulation is measured.
+	int rendered = CELL_WIDTH > 0 && CELL_HEIGHT > 0;
+	if (rendered && init_offscreen_renderer() < 0) {
+		return 1;
+	}
+	int n = sizeof(simulation_benches)/sizeof(*simulation_benches);
+	for (int i = 0; i < n; i++) {
+		run_bench(&simulation_benches[i]);
+	}
+	destroy_agents(&bench_agents);
+	if (rendered) {
+		reset_world();
+		n = sizeof(render_benches)/sizeof(*render_benches);
+		for (int i = 0; i < n; i++) {
+			run_bench(&render_benches[i]);
+		}
+	}
+	SDL_Quit();
+	return 0;
+}
@@ -0,0 +1,233 @@
+#include <SDL2/SDL.h>
+
+#include "game.h"
+#include "capture.h"
+
+#define CAPTURE_BUFFERS 4
+#define CAPTURE_FPS 40
+#define CAPTURE_FORMAT SDL_PIXELFORMAT_ARGB8888
+
+enum capture_format {
+	CAPTURE_Y4M,
+	CAPTURE_BMP,
+};
+
+/*
+ * Frames are rendered into one of two target textures. A frame is read
+ * back one frame late, from the target that is not being drawn to, so the
+ * GPU has had a whole frame to finish it. Read-back pixels go into a small
+ * ring of buffers that a background thread encodes and writes out.
+ */
+struct capture {
+	enum capture_format format;
+	const char *path;
+	FILE *file;
+	int blocking;
+	SDL_Texture *targets[2];
+	int frame;
+	unsigned int *buffers[CAPTURE_BUFFERS];
+	int next_free;
+	int next_full;
+	SDL_sem *free_buffers;
+	SDL_sem *full_buffers;
+	SDL_Thread *encoder;
+	SDL_atomic_t queued;
+	int frames_written;
+	int frames_dropped;
+	unsigned char *yuv;
+};
+
+static struct capture capture = { 0 };
+
+static int ends_with(const char *s, const char *suffix)
+{
+	int n = strlen(s);
+	int m = strlen(suffix);
+	return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+// BT.601 full-range coefficients in 8.8 fixed point, with 2x2 chroma
+// subsampling to match the C420jpeg header.
+static void write_y4m_frame(const unsigned int *pixels)
+{
+	int w = WINDOW_WIDTH;
+	int h = WINDOW_HEIGHT;
+	unsigned char *y_plane = capture.yuv;
+	unsigned char *u_plane = y_plane + w * h;
+	unsigned char *v_plane = u_plane + (w / 2) * (h / 2);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			unsigned int p = pixels[y * w + x];
+			int r = (p >> 16) & 0xff;
+			int g = (p >> 8) & 0xff;
+			int b = p & 0xff;
+			y_plane[y * w + x] = (77 * r + 150 * g + 29 * b) >> 8;
+		}
+	}
+	for (int y = 0; y < h / 2; y++) {
+		for (int x = 0; x < w / 2; x++) {
+			unsigned int p = pixels[2 * y * w + 2 * x];
+			int r = (p >> 16) & 0xff;
+			int g = (p >> 8) & 0xff;
+			int b = p & 0xff;
+			int i = y * (w / 2) + x;
+			u_plane[i] = ((-43 * r - 85 * g + 128 * b) >> 8) + 128;
+			v_plane[i] = ((128 * r - 107 * g - 21 * b) >> 8) + 128;
+		}
+	}
+	fputs("FRAME\n", capture.file);
+	fwrite(capture.yuv, 1, w * h * 3 / 2, capture.file);
+}
+
+static void write_bmp_frame(const unsigned int *pixels)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s%06d.bmp", capture.path,
+		 capture.frames_written);
+	SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
+		(void *)pixels, WINDOW_WIDTH, WINDOW_HEIGHT, 32,
+		WINDOW_WIDTH * 4, CAPTURE_FORMAT);
+	if (!surface) {
+		SDL_Log("Failed to wrap captured frame: %s", SDL_GetError());
+		return;
+	}
+	if (SDL_SaveBMP(surface, path) < 0) {
+		SDL_Log("Failed to write %s: %s", path, SDL_GetError());
+	}
+	SDL_FreeSurface(surface);
+}
+
+static int encoder_thread(void *data)
+{
+	for (;;) {
+		// Every queued frame posts once and finish_capture() posts
+		// once more, so an empty queue on waking means stop.
+		SDL_SemWait(capture.full_buffers);
+		if (SDL_AtomicGet(&capture.queued) == 0) {
+			return 0;
+		}
+		unsigned int *pixels = capture.buffers[capture.next_full];
+		if (capture.format == CAPTURE_Y4M) {
+			write_y4m_frame(pixels);
+		} else {
+			write_bmp_frame(pixels);
+		}
+		capture.frames_written++;
+		capture.next_full = (capture.next_full + 1) % CAPTURE_BUFFERS;
+		SDL_AtomicAdd(&capture.queued, -1);
+		SDL_SemPost(capture.free_buffers);
+	}
+}
+
+int init_capture(const char *path, int blocking)
+{
+	capture = (struct capture){
+		.path = path,
+		.blocking = blocking,
+		.format = ends_with(path, ".y4m") ? CAPTURE_Y4M : CAPTURE_BMP,
+	};
+	for (int i = 0; i < 2; i++) {
+		capture.targets[i] = SDL_CreateTexture(
+			renderer, CAPTURE_FORMAT, SDL_TEXTUREACCESS_TARGET,
+			WINDOW_WIDTH, WINDOW_HEIGHT);
+		if (!capture.targets[i]) {
+			SDL_Log("Failed to create capture target: %s",
+				SDL_GetError());
+			return -1;
+		}
+	}
+	for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+		capture.buffers[i] = malloc(WINDOW_WIDTH * WINDOW_HEIGHT *
+					    sizeof(*capture.buffers[i]));
+		if (!capture.buffers[i]) {
+			SDL_Log("Failed to allocate capture buffers");
+			return -1;
+		}
+	}
+	if (capture.format == CAPTURE_Y4M) {
+		capture.file = fopen(path, "wb");
+		capture.yuv = malloc(WINDOW_WIDTH * WINDOW_HEIGHT * 3 / 2);
+		if (!capture.file || !capture.yuv) {
+			SDL_Log("Failed to open %s for capture", path);
+			return -1;
+		}
+		fprintf(capture.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 "
+			"C420jpeg\n", WINDOW_WIDTH, WINDOW_HEIGHT,
+			CAPTURE_FPS);
+	}
+	capture.free_buffers = SDL_CreateSemaphore(CAPTURE_BUFFERS);
+	capture.full_buffers = SDL_CreateSemaphore(0);
+	if (!capture.free_buffers || !capture.full_buffers) {
+		SDL_Log("Failed to create capture semaphores: %s",
+			SDL_GetError());
+		return -1;
+	}
+	capture.encoder = SDL_CreateThread(encoder_thread, "encoder", 0);
+	if (!capture.encoder) {
+		SDL_Log("Failed to start encoder: %s", SDL_GetError());
+		return -1;
+	}
+	return 0;
+}
+
+void capture_begin_frame()
+{
+	if (!capture.encoder) {
+		return;
+	}
+	SDL_SetRenderTarget(renderer, capture.targets[capture.frame & 1]);
+}
+
+static void read_back(SDL_Texture *target)
+{
+	int ready = capture.blocking ?
+		SDL_SemWait(capture.free_buffers) == 0 :
+		SDL_SemTryWait(capture.free_buffers) == 0;
+	if (!ready) {
+		capture.frames_dropped++;
+		return;
+	}
+	SDL_SetRenderTarget(renderer, target);
+	SDL_RenderReadPixels(renderer, 0, CAPTURE_FORMAT,
+			     capture.buffers[capture.next_free],
+			     WINDOW_WIDTH * 4);
+	capture.next_free = (capture.next_free + 1) % CAPTURE_BUFFERS;
+	SDL_AtomicAdd(&capture.queued, 1);
+	SDL_SemPost(capture.full_buffers);
+}
+
+void capture_end_frame()
+{
+	if (!capture.encoder) {
+		return;
+	}
+	SDL_Texture *current = capture.targets[capture.frame & 1];
+	if (capture.frame > 0) {
+		read_back(capture.targets[(capture.frame - 1) & 1]);
+	}
+	SDL_SetRenderTarget(renderer, 0);
+	if (window) {
+		SDL_RenderCopy(renderer, current, 0, 0);
+	}
+	capture.frame++;
+}
+
+void finish_capture()
+{
+	if (!capture.encoder) {
+		return;
+	}
+	if (capture.frame > 0) {
+		capture.blocking = 1;
+		read_back(capture.targets[(capture.frame - 1) & 1]);
+		SDL_SetRenderTarget(renderer, 0);
+	}
+	SDL_SemPost(capture.full_buffers);
+	SDL_WaitThread(capture.encoder, 0);
+	capture.encoder = 0;
+	if (capture.file) {
+		fclose(capture.file);
+	}
+	SDL_Log("Captured %d frames (%d dropped)", capture.frames_written,
+		capture.frames_dropped);
+}
@@ -0,0 +1,15 @@
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+/*
+ * Records rendered frames. A path ending in .y4m is written as one raw
+ * YUV4MPEG2 stream, anything else is used as a prefix for a numbered BMP
+ * sequence. When blocking is unset, frames are dropped rather than
+ * stalling the render thread if the encoder falls behind.
+ */
+extern int init_capture(const char *path, int blocking);
+extern void capture_begin_frame();
+extern void capture_end_frame();
+extern void finish_capture();
+
+#endif
@@ -0,0 +1,113 @@
+#include <SDL2/SDL.h>
+
+#include "edit.h"
+
+void init_edit_queue(struct edit_queue *q)
+{
+	for (int i = 0; i < EDIT_QUEUE_SIZE; i++) {
+		SDL_AtomicSet(&q->slots[i].sequence, i);
+	}
+	SDL_AtomicSet(&q->tail, 0);
+	q->head = 0;
+}
+
+/*
+ * Each slot's sequence number says whose turn it is: it equals the
+ * position a producer may claim, and that position plus one once the
+ * edit inside is ready for the consumer. Positions wrap, so they are
+ * compared by signed difference.
+ */
+int edit_push(struct edit_queue *q, const struct edit *e)
+{
+	unsigned int pos = SDL_AtomicGet(&q->tail);
+	struct edit_slot *slot;
+	for (;;) {
+		slot = &q->slots[pos & (EDIT_QUEUE_SIZE - 1)];
+		unsigned int sequence = SDL_AtomicGet(&slot->sequence);
+		int diff = (int)(sequence - pos);
+		if (diff == 0) {
+			if (SDL_AtomicCAS(&q->tail, pos, pos + 1)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return -1;
+		}
+		pos = SDL_AtomicGet(&q->tail);
+	}
+	slot->edit = *e;
+	SDL_AtomicSet(&slot->sequence, pos + 1);
+	return 0;
+}
+
+int edit_pop(struct edit_queue *q, struct edit *e)
+{
+	struct edit_slot *slot = &q->slots[q->head & (EDIT_QUEUE_SIZE - 1)];
+	unsigned int sequence = SDL_AtomicGet(&slot->sequence);
+	if (sequence != q->head + 1) {
+		return -1;
+	}
+	*e = slot->edit;
+	SDL_AtomicSet(&slot->sequence, q->head + EDIT_QUEUE_SIZE);
+	q->head++;
+	return 0;
+}
+
+// One line per applied edit: tick, type, x, y, value.
+FILE *edit_log_open(const char *path, unsigned long long seed)
+{
+	FILE *log = fopen(path, "w");
+	if (!log) {
+		SDL_Log("Failed to open edit log %s", path);
+		return 0;
+	}
+	fprintf(log, "seed %llu\n", seed);
+	return log;
+}
+
+void edit_log_write(FILE *log, int tick, const struct edit *e)
+{
+	fprintf(log, "%d %d %d %d %d\n", tick, e->type, e->x, e->y,
+		e->value);
+}
+
+static void read_replay_line(struct edit_replay *r)
+{
+	int type;
+	if (fscanf(r->file, "%d %d %d %d %d", &r->tick, &type, &r->edit.x,
+		   &r->edit.y, &r->edit.value) != 5) {
+		r->tick = -1;
+		return;
+	}
+	r->edit.type = type;
+}
+
+int edit_replay_open(struct edit_replay *r, const char *path)
+{
+	*r = (struct edit_replay){ 0 };
+	r->file = fopen(path, "r");
+	if (!r->file) {
+		SDL_Log("Failed to open edit log %s", path);
+		return -1;
+	}
+	if (fscanf(r->file, " seed %llu", &r->seed) != 1) {
+		SDL_Log("Edit log %s does not start with a seed", path);
+		fclose(r->file);
+		r->file = 0;
+		return -1;
+	}
+	read_replay_line(r);
+	return 0;
+}
+
+// Takes the next logged edit if it was applied at or before this tick.
+// Called until it fails at each tick boundary, it hands back every edit
+// of that tick, however many there were.
+int edit_replay_next(struct edit_replay *r, int tick, struct edit *e)
+{
+	if (!r->file || r->tick < 0 || r->tick > tick) {
+		return -1;
+	}
+	*e = r->edit;
+	read_replay_line(r);
+	return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef _EDIT_H
+#define _EDIT_H
+
+#include <stdio.h>
+
+#include "game.h"
+
+// Must be a power of two.
+#define EDIT_QUEUE_SIZE 4096
+
+enum edit_type {
+	EDIT_TILE,
+	EDIT_ZONE,
+};
+
+// For EDIT_TILE value is an enum tile_type, for EDIT_ZONE an enum
+// zone_type.
+struct edit {
+	enum edit_type type;
+	int x;
+	int y;
+	int value;
+};
+
+struct edit_slot {
+	SDL_atomic_t sequence;
+	struct edit edit;
+};
+
+/*
+ * Bounded multi-producer, single-consumer queue. Any thread may push
+ * without taking a lock; a push fails rather than waits when the queue is
+ * full. Only the simulation thread pops.
+ */
+struct edit_queue {
+	struct edit_slot slots[EDIT_QUEUE_SIZE];
+	SDL_atomic_t tail;
+	unsigned int head;
+};
+
+// A log starts with the seed of the world it was recorded from.
+struct edit_replay {
+	FILE *file;
+	unsigned long long seed;
+	int tick;
+	struct edit edit;
+};
+
+extern void init_edit_queue(struct edit_queue *q);
+extern int edit_push(struct edit_queue *q, const struct edit *e);
+extern int edit_pop(struct edit_queue *q, struct edit *e);
+
+extern FILE *edit_log_open(const char *path, unsigned long long seed);
+extern void edit_log_write(FILE *log, int tick, const struct edit *e);
+
+extern int edit_replay_open(struct edit_replay *r, const char *path);
+extern int edit_replay_next(struct edit_replay *r, int tick, struct edit *e);
+
+#endif
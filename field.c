@@ -0,0 +1,289 @@
+#include <SDL2/SDL.h>
+
+#include "game.h"
+#include "field.h"
+
+// Fields only step every FIELD_PERIOD ticks; rates below are per step.
+#define FIELD_PERIOD 4
+
+// Each field cell covers FIELD_SCALE by FIELD_SCALE tiles, and its source
+// is the mean of theirs.
+#define FIELD_SCALE 4
+#define FIELD_WIDTH (((GRID_WIDTH) + (FIELD_SCALE) - 1) / (FIELD_SCALE))
+#define FIELD_HEIGHT (((GRID_HEIGHT) + (FIELD_SCALE) - 1) / (FIELD_SCALE))
+#define FIELD_SIZE ((FIELD_WIDTH) * (FIELD_HEIGHT))
+
+#define FIELD_FLOOR 1e-6f
+
+#define FIELD_BLOCK_ROWS 16
+#define FIELD_NUM_BLOCKS \
+	(((FIELD_HEIGHT) + (FIELD_BLOCK_ROWS) - 1) / (FIELD_BLOCK_ROWS))
+#define FIELD_MAX_WORKERS 16
+
+struct field_rules {
+	float diffusion;
+	float decay;
+	float sources[TILE_TYPE_COUNT];
+};
+
+static const struct field_rules field_rules[FIELD_TYPE_COUNT] = {
+	[FIELD_LAND_VALUE] = {
+		.diffusion = 0.5,
+		.decay = 0.1,
+		.sources = {
+			[TILE_WATER]      = 0.1,
+			[TILE_SERVICE]    = 0.2,
+			[TILE_COMMERCIAL] = 0.05,
+		},
+	},
+	[FIELD_POLLUTION] = {
+		.diffusion = 0.6,
+		.decay = 0.05,
+		.sources = {
+			[TILE_INDUSTRIAL] = 0.1,
+			[TILE_ROAD]       = 0.002,
+		},
+	},
+	[FIELD_TRAFFIC] = {
+		.diffusion = 0.3,
+		.decay = 0.2,
+		.sources = {
+			[TILE_ROAD]       = 0.02,
+			[TILE_COMMERCIAL] = 0.1,
+			[TILE_INDUSTRIAL] = 0.05,
+		},
+	},
+};
+
+/*
+ * Row blocks of the current step are handed to a fixed set of workers
+ * through an atomic block counter; the caller works alongside them and
+ * waits for every worker to report back before swapping buffers.
+ */
+static SDL_Thread *workers[FIELD_MAX_WORKERS] = { 0 };
+static int num_workers = 0;
+static SDL_sem *work_ready = 0;
+static SDL_sem *work_done = 0;
+static SDL_atomic_t next_block = { 0 };
+static struct fields *job = 0;
+
+/*
+ * Away from any source a field decays geometrically towards zero and would
+ * sink into denormals, which are several times slower to compute with, so
+ * anything below FIELD_FLOOR is flushed to zero. Fields are never negative.
+ */
+SIMD_KERNEL static void diffuse_row(struct field *f, int y)
+{
+	const float *restrict up =
+		&f->front[(y > 0 ? y - 1 : y) * FIELD_WIDTH];
+	const float *restrict row = &f->front[y * FIELD_WIDTH];
+	const float *restrict down =
+		&f->front[(y < FIELD_HEIGHT - 1 ? y + 1 : y) * FIELD_WIDTH];
+	const float *restrict source = &f->source[y * FIELD_WIDTH];
+	float *restrict out = &f->back[y * FIELD_WIDTH];
+	float k = f->diffusion * 0.25f;
+	float keep = 1.0f - f->decay;
+	int last = FIELD_WIDTH - 1;
+	out[0] = keep * (row[0] + k * (up[0] + down[0] + row[0] + row[1] -
+				       4 * row[0])) + source[0];
+	for (int x = 1; x < last; x++) {
+		float sum = up[x] + down[x] + row[x - 1] + row[x + 1];
+		float value = keep * (row[x] + k * (sum - 4 * row[x])) +
+			      source[x];
+		out[x] = value < FIELD_FLOOR ? 0 : value;
+	}
+	out[last] = keep * (row[last] + k * (up[last] + down[last] +
+					     row[last - 1] + row[last] -
+					     4 * row[last])) + source[last];
+	out[0] = out[0] < FIELD_FLOOR ? 0 : out[0];
+	out[last] = out[last] < FIELD_FLOOR ? 0 : out[last];
+}
+
+static void diffuse_block(struct fields *f, int block)
+{
+	int y0 = block * FIELD_BLOCK_ROWS;
+	int y1 = y0 + FIELD_BLOCK_ROWS;
+	if (y1 > FIELD_HEIGHT) {
+		y1 = FIELD_HEIGHT;
+	}
+	for (int i = 0; i < FIELD_TYPE_COUNT; i++) {
+		for (int y = y0; y < y1; y++) {
+			diffuse_row(&f->fields[i], y);
+		}
+	}
+}
+
+static void diffuse_blocks(struct fields *f)
+{
+	int block;
+	while ((block = SDL_AtomicAdd(&next_block, 1)) < FIELD_NUM_BLOCKS) {
+		diffuse_block(f, block);
+	}
+}
+
+static int field_worker(void *data)
+{
+	for (;;) {
+		SDL_SemWait(work_ready);
+		diffuse_blocks(job);
+		SDL_SemPost(work_done);
+	}
+	return 0;
+}
+
+static int init_field_workers()
+{
+	if (work_ready) {
+		return 0;
+	}
+	int wanted = SDL_GetCPUCount() - 1;
+	if (wanted > FIELD_NUM_BLOCKS - 1) {
+		wanted = FIELD_NUM_BLOCKS - 1;
+	}
+	if (wanted > FIELD_MAX_WORKERS) {
+		wanted = FIELD_MAX_WORKERS;
+	}
+	if (wanted <= 0) {
+		return 0;
+	}
+	work_ready = SDL_CreateSemaphore(0);
+	work_done = SDL_CreateSemaphore(0);
+	if (!work_ready || !work_done) {
+		SDL_Log("Failed to create field semaphores: %s",
+			SDL_GetError());
+		return -1;
+	}
+	for (int i = 0; i < wanted; i++) {
+		workers[i] = SDL_CreateThread(field_worker, "field", 0);
+		if (!workers[i]) {
+			SDL_Log("Failed to create field worker: %s",
+				SDL_GetError());
+			return -1;
+		}
+		num_workers++;
+	}
+	return 0;
+}
+
+int init_fields(struct fields *f, int parallel)
+{
+	*f = (struct fields){ 0 };
+	f->tiles = calloc(GRID_WIDTH * GRID_HEIGHT, sizeof(*f->tiles));
+	if (!f->tiles) {
+		SDL_Log("Failed to allocate fields");
+		return -1;
+	}
+	for (int i = 0; i < FIELD_TYPE_COUNT; i++) {
+		struct field *field = &f->fields[i];
+		field->front = calloc(FIELD_SIZE, sizeof(*field->front));
+		field->back = calloc(FIELD_SIZE, sizeof(*field->back));
+		field->source = calloc(FIELD_SIZE, sizeof(*field->source));
+		if (!field->front || !field->back || !field->source) {
+			SDL_Log("Failed to allocate fields");
+			return -1;
+		}
+		field->diffusion = field_rules[i].diffusion;
+		field->decay = field_rules[i].decay;
+	}
+	f->parallel = parallel;
+	return parallel ? init_field_workers() : 0;
+}
+
+void destroy_fields(struct fields *f)
+{
+	for (int i = 0; i < FIELD_TYPE_COUNT; i++) {
+		free(f->fields[i].front);
+		free(f->fields[i].back);
+		free(f->fields[i].source);
+	}
+	free(f->tiles);
+	*f = (struct fields){ 0 };
+}
+
+void update_fields(struct fields *f, int tick)
+{
+	if (!f->fields[0].front || tick % FIELD_PERIOD != 0) {
+		return;
+	}
+	if (f->parallel && num_workers > 0) {
+		job = f;
+		SDL_AtomicSet(&next_block, 0);
+		for (int i = 0; i < num_workers; i++) {
+			SDL_SemPost(work_ready);
+		}
+		diffuse_blocks(f);
+		for (int i = 0; i < num_workers; i++) {
+			SDL_SemWait(work_done);
+		}
+	} else {
+		for (int block = 0; block < FIELD_NUM_BLOCKS; block++) {
+			diffuse_block(f, block);
+		}
+	}
+	for (int i = 0; i < FIELD_TYPE_COUNT; i++) {
+		struct field *field = &f->fields[i];
+		float *tmp = field->front;
+		field->front = field->back;
+		field->back = tmp;
+	}
+	f->steps++;
+}
+
+// The cell's source is summed afresh from its tiles rather than adjusted
+// by the difference, so rounding never drifts however often it changes.
+void field_mark_tile(struct fields *f, int x, int y, enum tile_type type)
+{
+	if (!f->tiles) {
+		return;
+	}
+	f->tiles[y * GRID_WIDTH + x] = type;
+	int x0 = x / FIELD_SCALE * FIELD_SCALE;
+	int y0 = y / FIELD_SCALE * FIELD_SCALE;
+	int x1 = x0 + FIELD_SCALE;
+	int y1 = y0 + FIELD_SCALE;
+	if (x1 > GRID_WIDTH) {
+		x1 = GRID_WIDTH;
+	}
+	if (y1 > GRID_HEIGHT) {
+		y1 = GRID_HEIGHT;
+	}
+	float sums[FIELD_TYPE_COUNT] = { 0 };
+	for (int ty = y0; ty < y1; ty++) {
+		for (int tx = x0; tx < x1; tx++) {
+			int tile = f->tiles[ty * GRID_WIDTH + tx];
+			for (int i = 0; i < FIELD_TYPE_COUNT; i++) {
+				sums[i] += field_rules[i].sources[tile];
+			}
+		}
+	}
+	int cell = y0 / FIELD_SCALE * FIELD_WIDTH + x0 / FIELD_SCALE;
+	float area = (x1 - x0) * (y1 - y0);
+	for (int i = 0; i < FIELD_TYPE_COUNT; i++) {
+		f->fields[i].source[cell] = sums[i] / area;
+	}
+}
+
+float field_at(const struct fields *f, enum field_type type, int x, int y)
+{
+	if (!f->fields[type].front) {
+		return 0;
+	}
+	return f->fields[type].front[y / FIELD_SCALE * FIELD_WIDTH +
+				     x / FIELD_SCALE];
+}
+
+// Scans the cells rather than the tiles, which share their cell's value.
+float field_max(const struct fields *f, enum field_type type)
+{
+	const float *field = f->fields[type].front;
+	float max = 0;
+	if (!field) {
+		return 0;
+	}
+	for (int i = 0; i < FIELD_SIZE; i++) {
+		if (field[i] > max) {
+			max = field[i];
+		}
+	}
+	return max;
+}
@@ -0,0 +1,45 @@
+#ifndef _FIELD_H
+#define _FIELD_H
+
+#include "game.h"
+
+enum field_type {
+	FIELD_LAND_VALUE,
+	FIELD_POLLUTION,
+	FIELD_TRAFFIC,
+	FIELD_TYPE_COUNT,
+};
+
+struct field {
+	float *front;
+	float *back;
+	float *source;
+	float diffusion;
+	float decay;
+};
+
+/*
+ * Only one set of fields may be parallel: the row-block workers are shared
+ * by the whole process. Batch runs keep each world's fields serial and
+ * parallelise across worlds instead.
+ */
+struct fields {
+	struct field fields[FIELD_TYPE_COUNT];
+	// The type of every tile, to recompute a cell's sources from.
+	unsigned char *tiles;
+	int parallel;
+	// Counts steps, so readers can tell when the values have moved.
+	int steps;
+};
+
+extern int init_fields(struct fields *f, int parallel);
+extern void destroy_fields(struct fields *f);
+extern void update_fields(struct fields *f, int tick);
+
+extern void field_mark_tile(struct fields *f, int x, int y,
+			    enum tile_type type);
+extern float field_at(const struct fields *f, enum field_type type, int x,
+		      int y);
+extern float field_max(const struct fields *f, enum field_type type);
+
+#endif
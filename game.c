@@ -1,7 +1,9 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <math.h>
+#include <unistd.h>
 
 #include <SDL2/SDL.h>
 
@@ -9,10 +11,23 @@
 #include "render.h"
 #include "menu.h"
 #include "simulate.h"
+#include "batch.h"
+#include "capture.h"
+#include "script.h"
+#include "timeline.h"
+
+#define BATCH_DEFAULT_TICKS 10000
+
+#define FRAME_MS 25
+#define FAST_FORWARD_BUDGET_MS 20
+#define FAST_FORWARD_BATCH 16
+#define HISTORY_DEFAULT_MB 64
+#define SCRUB_TICKS 64
+#define ZOOM_STEP 1.25f
+#define PAN_PIXELS 32
 
 SDL_Window *window = 0;
 SDL_Renderer *renderer = 0;
-struct tile grid[GRID_HEIGHT][GRID_WIDTH] = { 0 };
 
 static struct graph *simple_graph()
 {
@@ -30,47 +45,446 @@ static struct graph *simple_graph()
 	return &g;
 }
 
-int main(int argc, char **argv)
+// Selected with the number keys; the left mouse button places the
+// selected tool, and dragging paints it.
+static const struct edit tools[] = {
+	{ .type = EDIT_TILE, .value = TILE_ROAD },
+	{ .type = EDIT_TILE, .value = TILE_HOUSE },
+	{ .type = EDIT_ZONE, .value = ZONE_RESIDENTIAL },
+	{ .type = EDIT_ZONE, .value = ZONE_COMMERCIAL },
+	{ .type = EDIT_ZONE, .value = ZONE_INDUSTRIAL },
+	{ .type = EDIT_ZONE, .value = ZONE_SERVICE },
+	{ .type = EDIT_ZONE, .value = ZONE_NONE },
+};
+#define NUM_TOOLS ((int)(sizeof(tools)/sizeof(*tools)))
+
+static struct edit_replay replay = { 0 };
+
+static int init_display(const char *title, int headless)
 {
-	srand(time(NULL));
-	window = SDL_CreateWindow(argv[0], SDL_WINDOWPOS_UNDEFINED,
-				  SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH,
-				  WINDOW_HEIGHT, 0);
-	if (!window) {
-		SDL_Log("Failed to create window: %s", SDL_GetError());
-		exit(1);
+	if (headless) {
+		SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+		SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(
+			0, WINDOW_WIDTH, WINDOW_HEIGHT, 32,
+			SDL_PIXELFORMAT_ARGB8888);
+		if (!surface) {
+			SDL_Log("Failed to create offscreen surface: %s",
+				SDL_GetError());
+			return -1;
+		}
+		renderer = SDL_CreateSoftwareRenderer(surface);
+	} else {
+		window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED,
+					  SDL_WINDOWPOS_UNDEFINED,
+					  WINDOW_WIDTH, WINDOW_HEIGHT, 0);
+		if (!window) {
+			SDL_Log("Failed to create window: %s",
+				SDL_GetError());
+			return -1;
+		}
+		renderer = SDL_CreateRenderer(window, 0,
+					      SDL_RENDERER_ACCELERATED |
+					      SDL_RENDERER_TARGETTEXTURE);
 	}
-	renderer = SDL_CreateRenderer(window, 0, SDL_RENDERER_ACCELERATED);
 	if (!renderer) {
 		SDL_Log("Failed to create renderer: %s", SDL_GetError());
+		return -1;
+	}
+	return 0;
+}
+
+static void use_tool(struct world *w, int tool, int mouse_x, int mouse_y)
+{
+	struct edit e = tools[tool];
+	render_screen_to_tile(mouse_x, mouse_y, &e.x, &e.y);
+	if (simulate_edit(w, &e) < 0) {
+		SDL_Log("Edit queue full, dropping edit");
+	}
+}
+
+// Replayed edits bypass the queue, so however many were logged for a
+// tick they all land at that tick.
+static void step(struct world *w)
+{
+	struct edit e;
+	while (edit_replay_next(&replay, w->tick, &e) == 0) {
+		simulate_apply_edit(w, &e);
+	}
+	simulate(w);
+	timeline_record(w);
+}
+
+// Only tiles that differ between what was shown and what will be shown
+// need their chunks redrawn.
+static void mark_changed_tiles(const struct tile from[][GRID_WIDTH],
+			       const struct tile to[][GRID_WIDTH])
+{
+	for (int y = 0; y < GRID_HEIGHT; y++) {
+		for (int x = 0; x < GRID_WIDTH; x++) {
+			if (from[y][x].type != to[y][x].type) {
+				render_mark_tile(x, y);
+			}
+		}
+	}
+}
+
+/*
+ * Moves the history view to the given tick, or back to the live world if
+ * that is at or past the present. The simulation is paused while the
+ * view is shown.
+ */
+static struct world *scrub(struct world *shown, struct world *live,
+			   struct world *view, int tick)
+{
+	if (tick >= live->tick) {
+		mark_changed_tiles(shown->grid, live->grid);
+		return live;
+	}
+	static struct tile before[GRID_HEIGHT][GRID_WIDTH];
+	memcpy(before, shown->grid, sizeof(before));
+	if (timeline_seek(tick, view) < 0) {
+		return shown;
+	}
+	mark_changed_tiles(before, view->grid);
+	SDL_Log("Viewing tick %d of %d", view->tick, live->tick);
+	return view;
+}
+
+// Runs as many ticks as fit in the frame budget, never past tick end;
+// tile and graph updates are coalesced until the single frame rendered
+// afterwards.
+static void fast_forward(struct world *w, int end)
+{
+	unsigned long long start = SDL_GetTicks64();
+	do {
+		int batch = end - w->tick;
+		if (batch > FAST_FORWARD_BATCH) {
+			batch = FAST_FORWARD_BATCH;
+		}
+		for (int i = 0; i < batch; i++) {
+			step(w);
+		}
+	} while (w->tick < end &&
+		 SDL_GetTicks64() - start < FAST_FORWARD_BUDGET_MS);
+}
+
+// Runs the ticks a script has asked for, up to a frame's budget; the
+// rest carry over to the next frame.
+static int run_script_ticks(struct world *w)
+{
+	int ticks = script_steps();
+	if (ticks == 0) {
+		return 0;
+	}
+	unsigned long long start = SDL_GetTicks64();
+	int ran = 0;
+	script_begin_ticks();
+	do {
+		step(w);
+		ran++;
+	} while (ran < ticks &&
+		 SDL_GetTicks64() - start < FAST_FORWARD_BUDGET_MS);
+	script_end_ticks(w, ran);
+	return ran;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-a] [-s seed] [-b instances [-t ticks] "
+		"[-j threads]]\n", name);
+	fprintf(stderr, "       %s [-af] [-s seed] [-H [-t ticks]] "
+		"[-r out.y4m|prefix] [-e log] [-p log] [-S socket|-]\n"
+		"       [-m megabytes]\n", name);
+	fprintf(stderr, "  -a  track individual residents (agent layer)\n");
+	fprintf(stderr, "  -f  start in fast-forward (toggle with f)\n");
+	fprintf(stderr, "  -s  seed for the first city\n");
+	fprintf(stderr, "  -b  run this many cities headless and print "
+		"summary stats\n");
+	fprintf(stderr, "  -t  ticks per city in batch mode (default %d)\n",
+		BATCH_DEFAULT_TICKS);
+	fprintf(stderr, "  -j  batch worker threads (default: one per CPU)\n");
+	fprintf(stderr, "  -H  render offscreen without a window for -t "
+		"ticks\n");
+	fprintf(stderr, "  -r  record frames as a .y4m stream or a numbered "
+		"BMP sequence\n");
+	fprintf(stderr, "  -e  write every applied edit to log\n");
+	fprintf(stderr, "  -p  replay the edits in log at their ticks, on "
+		"the seed it was recorded with\n");
+	fprintf(stderr, "  -m  history kept for scrubbing with [ and ] "
+		"(default %d, 0 for none)\n", HISTORY_DEFAULT_MB);
+	fprintf(stderr, "  -S  take commands on a Unix socket or stdin; "
+		"ticks only run when asked.\n"
+		"      With -H, runs until told to quit or stdin closes\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct batch_options batch = {
+		.ticks = BATCH_DEFAULT_TICKS,
+		.threads = SDL_GetCPUCount(),
+		.seed = time(NULL),
+	};
+	enum overlay_type overlay = OVERLAY_NONE;
+	struct world *world = 0;
+	const char *record_path = 0;
+	const char *edit_log_path = 0;
+	const char *replay_path = 0;
+	const char *script_path = 0;
+	int seed_given = 0;
+	int history_mb = HISTORY_DEFAULT_MB;
+	struct world *view = 0;
+	struct world *shown = 0;
+	// What the overlay was last coloured from; any change recolours it
+	// in full.
+	enum overlay_type drawn_overlay = OVERLAY_NONE;
+	const struct world *drawn_world = 0;
+	int drawn_tick = -1;
+	int headless = 0;
+	int tool = 0;
+	int painting = 0;
+	int panning = 0;
+	int fast = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "ab:e:fj:m:p:r:s:t:HS:")) != -1) {
+		switch (opt) {
+		case 'a':
+			batch.agents = 1;
+			break;
+		case 'b':
+			batch.instances = atoi(optarg);
+			break;
+		case 'j':
+			batch.threads = atoi(optarg);
+			break;
+		case 's':
+			batch.seed = strtoull(optarg, 0, 10);
+			seed_given = 1;
+			break;
+		case 't':
+			batch.ticks = atoi(optarg);
+			break;
+		case 'r':
+			record_path = optarg;
+			break;
+		case 'e':
+			edit_log_path = optarg;
+			break;
+		case 'm':
+			history_mb = atoi(optarg);
+			break;
+		case 'p':
+			replay_path = optarg;
+			break;
+		case 'H':
+			headless = 1;
+			break;
+		case 'S':
+			script_path = optarg;
+			break;
+		case 'f':
+			fast = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (batch.instances > 0) {
+		return run_batch(&batch) < 0;
+	}
+	// A replay only reproduces the run on the city it was recorded on.
+	if (replay_path) {
+		if (edit_replay_open(&replay, replay_path) < 0) {
+			exit(1);
+		}
+		if (seed_given && batch.seed != replay.seed) {
+			SDL_Log("Seed %llu conflicts with seed %llu in %s",
+				batch.seed, replay.seed, replay_path);
+			exit(1);
+		}
+		batch.seed = replay.seed;
+	}
+	if (init_display(argv[0], headless) < 0) {
 		exit(1);
 	}
 	if (init_render() < 0) {
 		goto quit;
 	}
-	init_menu();
-	init_simulate();
+	if (record_path && init_capture(record_path, headless) < 0) {
+		goto quit;
+	}
+	int options = WORLD_RENDERED | WORLD_PARALLEL_FIELDS;
+	if (batch.agents) {
+		options |= WORLD_AGENTS;
+	}
+	if (history_mb > 0) {
+		options |= WORLD_HISTORY;
+	}
+	world = create_world(batch.seed, options);
+	if (!world) {
+		goto quit;
+	}
+	shown = world;
+	if (history_mb > 0) {
+		view = calloc(1, sizeof(*view));
+		if (!view || init_timeline((size_t)history_mb << 20) < 0) {
+			SDL_Log("Failed to set up history");
+			goto quit;
+		}
+		timeline_record(world);
+	}
+	if (edit_log_path) {
+		world->edit_log = edit_log_open(edit_log_path, batch.seed);
+		if (!world->edit_log) {
+			goto quit;
+		}
+	}
+	if (script_path && init_script(script_path, world) < 0) {
+		goto quit;
+	}
+	init_menu(world);
 	render_push_graph(simple_graph());
 	unsigned long long last_frame = SDL_GetTicks64() - 1000;
 	for (;;) {
 		SDL_Event event;
 		while (SDL_PollEvent(&event)) {
-			if (event.type == SDL_QUIT) {
+			switch (event.type) {
+			case SDL_QUIT:
 				goto quit;
+			case SDL_MOUSEBUTTONDOWN:
+				if (event.button.button == SDL_BUTTON_LEFT) {
+					painting = 1;
+					use_tool(world, tool, event.button.x,
+						 event.button.y);
+				} else if (event.button.button ==
+					   SDL_BUTTON_RIGHT) {
+					panning = 1;
+				}
+				continue;
+			case SDL_MOUSEBUTTONUP:
+				if (event.button.button == SDL_BUTTON_LEFT) {
+					painting = 0;
+				} else if (event.button.button ==
+					   SDL_BUTTON_RIGHT) {
+					panning = 0;
+				}
+				continue;
+			case SDL_MOUSEMOTION:
+				if (painting) {
+					use_tool(world, tool, event.motion.x,
+						 event.motion.y);
+				}
+				if (panning) {
+					render_pan(-event.motion.xrel,
+						   -event.motion.yrel);
+				}
+				continue;
+			case SDL_MOUSEWHEEL: {
+				if (event.wheel.y == 0) {
+					continue;
+				}
+				int mouse_x, mouse_y;
+				SDL_GetMouseState(&mouse_x, &mouse_y);
+				render_zoom(event.wheel.y > 0 ? ZOOM_STEP :
+					    1 / ZOOM_STEP, mouse_x, mouse_y);
+				continue;
+			}
+			case SDL_KEYDOWN:
+				break;
+			default:
+				continue;
+			}
+			SDL_Keycode key = event.key.keysym.sym;
+			if (key >= SDLK_1 && key < SDLK_1 + NUM_TOOLS) {
+				tool = key - SDLK_1;
+				continue;
+			}
+			switch (key) {
+			case SDLK_o:
+				overlay = (overlay + 1) % OVERLAY_TYPE_COUNT;
+				break;
+			case SDLK_f:
+				fast = !fast;
+				break;
+			case SDLK_LEFT:
+				render_pan(-PAN_PIXELS, 0);
+				break;
+			case SDLK_RIGHT:
+				render_pan(PAN_PIXELS, 0);
+				break;
+			case SDLK_UP:
+				render_pan(0, -PAN_PIXELS);
+				break;
+			case SDLK_DOWN:
+				render_pan(0, PAN_PIXELS);
+				break;
+			case SDLK_LEFTBRACKET:
+				if (view) {
+					shown = scrub(shown, world, view,
+						      shown->tick - SCRUB_TICKS);
+				}
+				break;
+			case SDLK_RIGHTBRACKET:
+				if (view) {
+					shown = scrub(shown, world, view,
+						      shown->tick + SCRUB_TICKS);
+				}
+				break;
 			}
 		}
+		if (headless && (script_attached() ? script_closed() :
+				 world->tick >= batch.ticks)) {
+			goto quit;
+		}
 		unsigned long long this_frame = SDL_GetTicks64();
-		if (this_frame - last_frame < 25) {
+		if (!headless && !fast && this_frame - last_frame < FRAME_MS) {
 			continue;
 		}
 		last_frame = this_frame;
-		simulate();
-		SDL_Log("Population: %d; Net Migration: %d", population,
-			-emigration);
-		render();
+		if (shown != world) {
+			// Scrubbing through history; the world is paused.
+		} else if (script_attached()) {
+			if (run_script_ticks(world) == 0 && headless) {
+				SDL_Delay(1);
+				continue;
+			}
+		} else if (fast) {
+			fast_forward(world,
+				     headless ? batch.ticks : INT_MAX);
+		} else {
+			step(world);
+		}
+		simulate_flush(world);
+		SDL_Log("Population: %d; Net Migration: %d", world->population,
+			-world->emigration);
+		// The live world marks the tiles it changes; a history view
+		// only changes by scrubbing, which moves its tick.
+		simulate_overlay(shown, overlay,
+				 overlay != drawn_overlay ||
+				 shown != drawn_world ||
+				 (shown != world && shown->tick != drawn_tick));
+		drawn_overlay = overlay;
+		drawn_world = shown;
+		drawn_tick = shown->tick;
+		capture_begin_frame();
+		render(shown);
+		capture_end_frame();
 		SDL_RenderPresent(renderer);
 	}
 quit:
+	finish_script();
+	finish_capture();
+	finish_timeline();
+	free(view);
+	if (replay.file) {
+		fclose(replay.file);
+	}
+	if (world) {
+		if (world->edit_log) {
+			fclose(world->edit_log);
+		}
+		destroy_world(world);
+	}
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 	return 0;
@@ -1,34 +1,67 @@
 #ifndef _GAME_H
 #define _GAME_H
 
+#include <SDL2/SDL.h>
+
 #define WINDOW_WIDTH 1024
 #define WINDOW_HEIGHT 768
 
+#ifndef GRID_WIDTH
 #define GRID_WIDTH 32
+#endif
+#ifndef GRID_HEIGHT
 #define GRID_HEIGHT 32
+#endif
 
 #define CELL_WIDTH ((WINDOW_WIDTH)/(GRID_WIDTH))
 #define CELL_HEIGHT ((WINDOW_HEIGHT)/(GRID_HEIGHT))
 
 #define OVERLAY_TEXT_SIZE 3
 
+/*
+ * Vectorizable kernels are compiled once per listed instruction set and
+ * the best one is picked at load time, so a generic build still uses AVX2
+ * where the host has it. Needs ifunc support, hence Linux only.
+ */
+#if defined(__linux__) && defined(__x86_64__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define SIMD_KERNEL __attribute__((target_clones("avx2", "sse4.2", "default")))
+#endif
+#endif
+#ifndef SIMD_KERNEL
+#define SIMD_KERNEL
+#endif
+
 enum tile_type {
 	TILE_GRASS,
 	TILE_WATER,
 	TILE_ROAD,
 	TILE_HOUSE,
+	TILE_COMMERCIAL,
+	TILE_INDUSTRIAL,
+	TILE_SERVICE,
 	TILE_TYPE_COUNT,
 };
 
+enum zone_type {
+	ZONE_NONE,
+	ZONE_RESIDENTIAL,
+	ZONE_COMMERCIAL,
+	ZONE_INDUSTRIAL,
+	ZONE_SERVICE,
+	ZONE_TYPE_COUNT,
+};
+
 struct tile {
 	enum tile_type type;
+	enum zone_type zone;
 	union {
+		int index;
 		int house_index;
 	};
 };
 
 extern SDL_Window *window;
 extern SDL_Renderer *renderer;
-extern struct tile grid[GRID_HEIGHT][GRID_WIDTH];
 
 #endif
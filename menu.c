@@ -4,11 +4,12 @@
 
 static struct menu *menus[MAX_MENUS] = { 0 };
 static int num_menus = 0;
+static const struct world *world = 0;
 
 static const char *population_callback()
 {
 	static char buffer[128] = { 0 };
-	snprintf(buffer, 128, "Population: %06d", population);
+	snprintf(buffer, 128, "Population: %06d", world->population);
 	return buffer;
 }
 
@@ -35,8 +36,9 @@ static struct menu *build_simple_menu()
 	return &m;
 }
 
-void init_menu()
-{	
+void init_menu(const struct world *w)
+{
+	world = w;
 	push_menu(build_simple_menu());
 }
 
@@ -5,6 +5,8 @@
 
 #include <SDL2/SDL.h>
 
+struct world;
+
 typedef const char *(*text_callback)();
 
 struct menu_entry {
@@ -25,7 +27,7 @@ struct menu {
 	SDL_Color border;
 };
 
-extern void init_menu();
+extern void init_menu(const struct world *w);
 extern void push_menu(struct menu *m);
 
 #endif
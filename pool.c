@@ -0,0 +1,115 @@
+#include <SDL2/SDL.h>
+
+#include "pool.h"
+
+/*
+ * Tasks are split evenly into one deque per thread up front. A thread pops
+ * from the back of its own deque and, once that is empty, steals from the
+ * front of the others', so uneven task lengths even out. No tasks are
+ * added while running, so a thread is done when every deque is empty.
+ */
+struct pool_deque {
+	SDL_SpinLock lock;
+	int head;
+	int tail;
+};
+
+struct pool {
+	struct pool_deque *deques;
+	int num_threads;
+	pool_task task;
+	void *data;
+};
+
+struct pool_worker {
+	struct pool *pool;
+	int id;
+	SDL_Thread *thread;
+};
+
+static int pop_task(struct pool_deque *d)
+{
+	int index = -1;
+	SDL_AtomicLock(&d->lock);
+	if (d->head < d->tail) {
+		index = --d->tail;
+	}
+	SDL_AtomicUnlock(&d->lock);
+	return index;
+}
+
+static int steal_task(struct pool_deque *d)
+{
+	int index = -1;
+	SDL_AtomicLock(&d->lock);
+	if (d->head < d->tail) {
+		index = d->head++;
+	}
+	SDL_AtomicUnlock(&d->lock);
+	return index;
+}
+
+static int next_task(struct pool *p, int id)
+{
+	int index = pop_task(&p->deques[id]);
+	for (int i = 1; index < 0 && i < p->num_threads; i++) {
+		index = steal_task(&p->deques[(id + i) % p->num_threads]);
+	}
+	return index;
+}
+
+static int pool_worker(void *data)
+{
+	struct pool_worker *worker = data;
+	struct pool *p = worker->pool;
+	int index;
+	while ((index = next_task(p, worker->id)) >= 0) {
+		p->task(p->data, index);
+	}
+	return 0;
+}
+
+int pool_run(int num_threads, int num_tasks, pool_task task, void *data)
+{
+	if (num_threads < 1) {
+		num_threads = 1;
+	}
+	if (num_threads > num_tasks && num_tasks > 0) {
+		num_threads = num_tasks;
+	}
+	struct pool p = {
+		.deques = calloc(num_threads, sizeof(*p.deques)),
+		.num_threads = num_threads,
+		.task = task,
+		.data = data,
+	};
+	struct pool_worker *workers = calloc(num_threads, sizeof(*workers));
+	if (!p.deques || !workers) {
+		SDL_Log("Failed to allocate pool of %d threads", num_threads);
+		free(p.deques);
+		free(workers);
+		return -1;
+	}
+	for (int i = 0; i < num_threads; i++) {
+		p.deques[i].head = num_tasks * i / num_threads;
+		p.deques[i].tail = num_tasks * (i + 1) / num_threads;
+		workers[i] = (struct pool_worker){ .pool = &p, .id = i };
+	}
+	// The calling thread works as worker 0; if a thread can't be
+	// started its deque is simply stolen from by the others.
+	for (int i = 1; i < num_threads; i++) {
+		workers[i].thread = SDL_CreateThread(pool_worker, "pool",
+						     &workers[i]);
+		if (!workers[i].thread) {
+			SDL_Log("Failed to create pool thread: %s",
+				SDL_GetError());
+		}
+	}
+	pool_worker(&workers[0]);
+	for (int i = 1; i < num_threads; i++) {
+		SDL_WaitThread(workers[i].thread, 0);
+	}
+	free(p.deques);
+	free(workers);
+	return 0;
+}
@@ -0,0 +1,9 @@
+#ifndef _POOL_H
+#define _POOL_H
+
+typedef void (*pool_task)(void *data, int index);
+
+extern int pool_run(int num_threads, int num_tasks, pool_task task,
+		    void *data);
+
+#endif
@@ -1,30 +1,51 @@
+#include <math.h>
+
 #include <SDL2/SDL.h>
 
 #include "game.h"
 #include "menu.h"
 #include "render.h"
+#include "simulate.h"
 #include "font8x8_basic.h"
 
+#define RENDER_LOD_LEVELS 4
+#define RENDER_ALL_LEVELS ((1 << RENDER_LOD_LEVELS) - 1)
+
+/*
+ * Level 0 of a chunk's pyramid is drawn from its tiles and each coarser
+ * level is a 2x2 box-filtered copy of the one below, so zoomed out the
+ * renderer never samples more texels than it draws. Only the level in use
+ * has a texture. Bit n of needs_update is set while level n is stale.
+ */
 struct rendering_tile {
-	SDL_Surface *surface;
+	SDL_Surface *surfaces[RENDER_LOD_LEVELS];
 	SDL_Texture *texture;
+	int texture_level;
 	int needs_update;
 };
 
+// x and y are the map pixel shown at the window's top-left corner.
+struct camera {
+	float x;
+	float y;
+	float zoom;
+};
+
 struct compiled_menu {
 	int w;
 	int h;
-	int dynamic;
-	SDL_Texture *texture;
 	struct menu *menu;
 };
 
-struct compiled_graph {
-	SDL_Texture *texture;
-	struct graph *graph;
+struct hud_batch {
+	SDL_Vertex *vertices;
+	int *indices;
+	int num_quads;
+	int max_quads;
 };
 
-#define RGBA(R, G, B, A) ((A) << 24 | (R) << 16 | (G) << 8 | (B))
+#define RGBA(R, G, B, A) \
+	((unsigned int)(A) << 24 | (R) << 16 | (G) << 8 | (B))
 
 #define RGRID_WIDTH 4
 #define RGRID_HEIGHT 4
@@ -32,70 +53,154 @@ struct compiled_graph {
 #define RCELL_WIDTH ((GRID_WIDTH)/(RGRID_HEIGHT))
 #define RCELL_HEIGHT ((GRID_HEIGHT)/(RGRID_HEIGHT))
 
+#define CHUNK_WIDTH (RCELL_WIDTH * CELL_WIDTH)
+#define CHUNK_HEIGHT (RCELL_HEIGHT * CELL_HEIGHT)
+
+#define MIN_ZOOM (1.0f / (1 << (RENDER_LOD_LEVELS - 1)))
+#define MAX_ZOOM 8.0f
+
 #define MAX_GRAPHS 32
 
 #define GRAPH_LINE_WIDTH 2
 #define GRAPH_PADDING 3
 
-#define GRAPH_BG_COLOR RGBA(255, 255, 255, 255)
-#define GRAPH_FG_COLOR RGBA(  0,   0,   0, 255)
-#define GRAPH_LN_COLOR RGBA(255,   0,   0, 255)
+#define GRAPH_BG_COLOR ((SDL_Color){ 255, 255, 255, 255 })
+#define GRAPH_FG_COLOR ((SDL_Color){   0,   0,   0, 255 })
+#define GRAPH_LN_COLOR ((SDL_Color){ 255,   0,   0, 255 })
+
+/*
+ * The HUD atlas holds the 128 font glyphs in a 16x8 grid of 8x8 cells,
+ * followed by one solid cell used for untextured (filled) quads. Every
+ * menu and graph is emitted as quads sampling this atlas, so the whole HUD
+ * is drawn with a single SDL_RenderGeometry call per frame.
+ */
+#define HUD_GLYPHS_PER_ROW 16
+#define HUD_ATLAS_WIDTH (HUD_GLYPHS_PER_ROW * 8)
+#define HUD_ATLAS_HEIGHT ((128 / HUD_GLYPHS_PER_ROW + 1) * 8)
+#define HUD_SOLID_U ((4.0f) / (HUD_ATLAS_WIDTH))
+#define HUD_SOLID_V ((HUD_ATLAS_HEIGHT - 4.0f) / (HUD_ATLAS_HEIGHT))
+
+#define HUD_INITIAL_QUADS 1024
+
+#define OVERLAY_ALPHA 160
+#define OVERLAY_LUT_SIZE 256
 
 static struct rendering_tile rendering_grid[RGRID_HEIGHT][RGRID_WIDTH] = { 0 };
+static struct camera camera = { .zoom = 1 };
 
 static const char *tile_bitmap_paths[TILE_TYPE_COUNT] = {
-		/* TILE_GRASS */ "assets/grass.bmp",
-		/* TILE_WATER */ "assets/water.bmp",
-		/* TILE_ROAD  */ "assets/road.bmp",
-		/* TILE_HOUSE */ "assets/house.bmp",
+		/* TILE_GRASS      */ "assets/grass.bmp",
+		/* TILE_WATER      */ "assets/water.bmp",
+		/* TILE_ROAD       */ "assets/road.bmp",
+		/* TILE_HOUSE      */ "assets/house.bmp",
+		/* TILE_COMMERCIAL */ "assets/commercial.bmp",
+		/* TILE_INDUSTRIAL */ "assets/industrial.bmp",
+		/* TILE_SERVICE    */ "assets/service.bmp",
 };
 static SDL_Surface *tile_surfaces[TILE_TYPE_COUNT] = { 0 };
 
 static struct compiled_menu menus[MAX_MENUS] = { 0 };
 static int num_menus = 0;
 
-static struct compiled_graph graphs[MAX_GRAPHS] = { 0 };
+static struct graph *graphs[MAX_GRAPHS] = { 0 };
 static int num_graphs = 0;
 
-static unsigned int sdl_color_to_uint32(const SDL_Color *c)
+static SDL_Texture *hud_atlas = 0;
+static struct hud_batch hud = { 0 };
+
+static SDL_Texture *overlay_texture = 0;
+static unsigned int overlay_lut[OVERLAY_LUT_SIZE] = { 0 };
+static unsigned int overlay_pixels[GRID_HEIGHT * GRID_WIDTH] = { 0 };
+static int overlay_dirty = 0;
+static int overlay_shown = 0;
+
+static void hud_grow()
+{
+	int max_quads = hud.max_quads ? hud.max_quads * 2 : HUD_INITIAL_QUADS;
+	SDL_Vertex *vertices = realloc(hud.vertices,
+				       max_quads * 4 * sizeof(*vertices));
+	int *indices = realloc(hud.indices, max_quads * 6 * sizeof(*indices));
+	if (!vertices || !indices) {
+		SDL_Log("Failed to grow HUD batch to %d quads", max_quads);
+		exit(1);
+	}
+	// The index pattern is the same for every quad, so it is written once
+	// here rather than on every push.
+	for (int i = hud.max_quads; i < max_quads; i++) {
+		int *q = &indices[i * 6];
+		q[0] = i * 4 + 0;
+		q[1] = i * 4 + 1;
+		q[2] = i * 4 + 2;
+		q[3] = i * 4 + 0;
+		q[4] = i * 4 + 2;
+		q[5] = i * 4 + 3;
+	}
+	hud.vertices = vertices;
+	hud.indices = indices;
+	hud.max_quads = max_quads;
+}
+
+// Corners are given in winding order.
+static void hud_push_quad(const SDL_FPoint pos[4], const SDL_FPoint uv[4],
+			  SDL_Color color)
+{
+	if (hud.num_quads == hud.max_quads) {
+		hud_grow();
+	}
+	SDL_Vertex *v = &hud.vertices[hud.num_quads * 4];
+	for (int i = 0; i < 4; i++) {
+		v[i] = (SDL_Vertex){ pos[i], color, uv[i] };
+	}
+	hud.num_quads++;
+}
+
+static void hud_push_rect(float x, float y, float w, float h, SDL_Color color)
+{
+	SDL_FPoint pos[4] = { { x, y }, { x + w, y },
+			      { x + w, y + h }, { x, y + h } };
+	SDL_FPoint uv[4] = { { HUD_SOLID_U, HUD_SOLID_V },
+			     { HUD_SOLID_U, HUD_SOLID_V },
+			     { HUD_SOLID_U, HUD_SOLID_V },
+			     { HUD_SOLID_U, HUD_SOLID_V } };
+	hud_push_quad(pos, uv, color);
+}
+
+static void hud_push_glyph(float x, float y, int c, int size, SDL_Color color)
 {
-	unsigned int ret = 0;
-	ret |= (unsigned int)(c->a) << 24;
-	ret |= (unsigned int)(c->r) << 16;
-	ret |= (unsigned int)(c->g) <<  8;
-	ret |= (unsigned int)(c->b) <<  0;
-	return ret;
+	float u0 = (float)(c % HUD_GLYPHS_PER_ROW * 8) / HUD_ATLAS_WIDTH;
+	float v0 = (float)(c / HUD_GLYPHS_PER_ROW * 8) / HUD_ATLAS_HEIGHT;
+	float u1 = u0 + 8.0f / HUD_ATLAS_WIDTH;
+	float v1 = v0 + 8.0f / HUD_ATLAS_HEIGHT;
+	float s = 8 * size;
+	SDL_FPoint pos[4] = { { x, y }, { x + s, y },
+			      { x + s, y + s }, { x, y + s } };
+	SDL_FPoint uv[4] = { { u0, v0 }, { u1, v0 }, { u1, v1 }, { u0, v1 } };
+	hud_push_quad(pos, uv, color);
 }
 
-// TODO(cmgn): provided color must already be converted?
-static void write_text(SDL_Surface *surface, int x, int y, const char *text,
-		       int size, SDL_Color *color)
+static void write_text(int x, int y, const char *text, int size,
+		       SDL_Color color)
 {
-	unsigned int cint = sdl_color_to_uint32(color);
 	for (int k = 0; text[k]; k++) {
-		int c = text[k];
-		for (int j = 0; j < 8; j++) {
-			for (int i = 0; i < 8; i++) {
-				SDL_Rect rect = { x + (i + k * 8) * size,
-						  y + j * size, size, size };
-				int bit = font8x8_basic[c][j] & (1 << i);
-				if (bit) {
-					SDL_FillRect(surface, &rect, cint);
-				}
-			}
+		int c = text[k] & 0x7f;
+		if (c != ' ') {
+			hud_push_glyph(x + k * 8 * size, y, c, size, color);
 		}
 	}
 }
 
 static int init_rendering_tile(struct rendering_tile *rtile)
 {
-	rtile->surface = SDL_CreateRGBSurface(0, CELL_WIDTH * RCELL_WIDTH,
-					      CELL_HEIGHT * RCELL_HEIGHT, 32,
-					      0, 0, 0, 0);
-	if (!rtile->surface) {
-		return -1;
+	for (int level = 0; level < RENDER_LOD_LEVELS; level++) {
+		int w = CHUNK_WIDTH >> level;
+		int h = CHUNK_HEIGHT >> level;
+		rtile->surfaces[level] = SDL_CreateRGBSurface(
+			0, w > 0 ? w : 1, h > 0 ? h : 1, 32, 0, 0, 0, 0);
+		if (!rtile->surfaces[level]) {
+			return -1;
+		}
 	}
-	rtile->needs_update = 1;
+	rtile->needs_update = RENDER_ALL_LEVELS;
 	return 0;
 }
 
@@ -125,6 +230,73 @@ static int init_tile_surfaces()
 	return 0;
 }
 
+static int init_hud_atlas()
+{
+	SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(
+		0, HUD_ATLAS_WIDTH, HUD_ATLAS_HEIGHT, 32,
+		SDL_PIXELFORMAT_ARGB8888);
+	if (!surface) {
+		SDL_Log("Failed to create HUD atlas: %s", SDL_GetError());
+		return -1;
+	}
+	SDL_FillRect(surface, 0, 0);
+	for (int c = 0; c < 128; c++) {
+		int x = c % HUD_GLYPHS_PER_ROW * 8;
+		int y = c / HUD_GLYPHS_PER_ROW * 8;
+		for (int j = 0; j < 8; j++) {
+			for (int i = 0; i < 8; i++) {
+				SDL_Rect rect = { x + i, y + j, 1, 1 };
+				if (font8x8_basic[c][j] & (1 << i)) {
+					SDL_FillRect(surface, &rect,
+						     RGBA(255, 255, 255, 255));
+				}
+			}
+		}
+	}
+	SDL_Rect solid = { 0, HUD_ATLAS_HEIGHT - 8, 8, 8 };
+	SDL_FillRect(surface, &solid, RGBA(255, 255, 255, 255));
+	hud_atlas = SDL_CreateTextureFromSurface(renderer, surface);
+	SDL_FreeSurface(surface);
+	if (!hud_atlas) {
+		SDL_Log("Failed to create HUD texture: %s", SDL_GetError());
+		return -1;
+	}
+	SDL_SetTextureBlendMode(hud_atlas, SDL_BLENDMODE_BLEND);
+	SDL_SetTextureScaleMode(hud_atlas, SDL_ScaleModeNearest);
+	return 0;
+}
+
+// Blue through green to orange, with a fixed alpha so the map
+// stays visible underneath.
+static void init_overlay_lut()
+{
+	for (int i = 0; i < OVERLAY_LUT_SIZE; i++) {
+		float t = (float)i / (OVERLAY_LUT_SIZE - 1);
+		float lo = t < 0.5f ? t * 2 : 1;
+		float hi = t < 0.5f ? 0 : (t - 0.5f) * 2;
+		int r = 255 * hi;
+		int g = 255 * (lo - hi / 2);
+		int b = 255 * (1 - lo);
+		overlay_lut[i] = RGBA(r, g, b, OVERLAY_ALPHA);
+	}
+}
+
+static int init_overlay()
+{
+	overlay_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+					    SDL_TEXTUREACCESS_STREAMING,
+					    GRID_WIDTH, GRID_HEIGHT);
+	if (!overlay_texture) {
+		SDL_Log("Failed to create overlay texture: %s",
+			SDL_GetError());
+		return -1;
+	}
+	SDL_SetTextureBlendMode(overlay_texture, SDL_BLENDMODE_BLEND);
+	SDL_SetTextureScaleMode(overlay_texture, SDL_ScaleModeNearest);
+	init_overlay_lut();
+	return 0;
+}
+
 typedef int (*init_function)();
 
 int init_render()
@@ -132,6 +304,8 @@ int init_render()
 	init_function init_functions[] = {
 		init_rendering_grid,
 		init_tile_surfaces,
+		init_hud_atlas,
+		init_overlay,
 	};
 	int num_init_functions = sizeof(init_functions)/sizeof(*init_functions);
 	for (int i = 0; i < num_init_functions; i++) {
@@ -142,49 +316,123 @@ int init_render()
 	return 0;
 }
 
-static void update_rendering_tile(int x, int y)
+static void draw_rendering_tile(const struct world *w,
+				struct rendering_tile *rtile, int x, int y)
 {
-	struct rendering_tile *rtile = &rendering_grid[y][x];
-	if (!rtile->needs_update) {
-		return;
-	}
-	if (rtile->texture) {
-		SDL_DestroyTexture(rtile->texture);
-	}
 	for (int dy = 0; dy < RCELL_HEIGHT; dy++) {
-		struct tile *grid_row = grid[y * RCELL_HEIGHT + dy];
+		const struct tile *grid_row = w->grid[y * RCELL_HEIGHT + dy];
 		for (int dx = 0; dx < RCELL_WIDTH; dx++) {
-			struct tile *tile = &grid_row[x * RCELL_WIDTH + dx];
+			const struct tile *tile =
+				&grid_row[x * RCELL_WIDTH + dx];
 			SDL_Surface *tsurface = tile_surfaces[tile->type];
 			SDL_Rect rect = { dx * CELL_WIDTH, dy * CELL_HEIGHT,
 					  CELL_WIDTH, CELL_HEIGHT };
-			SDL_BlitScaled(tsurface, 0, rtile->surface, &rect);
+			SDL_BlitScaled(tsurface, 0, rtile->surfaces[0], &rect);
 		}
 	}
-	rtile->texture = SDL_CreateTextureFromSurface(renderer,
-						      rtile->surface);
-	rtile->needs_update = 0;
 }
 
-static void update_rendering_grid()
+// Averages each 2x2 block of 32-bit pixels, one byte channel at a time;
+// an odd last row or column is averaged with itself.
+static void downsample(SDL_Surface *src, SDL_Surface *dst)
 {
-	for (int y = 0; y < RGRID_HEIGHT; y++) {
-		for (int x = 0; x < RGRID_WIDTH; x++) {
-			update_rendering_tile(x, y);
+	SDL_LockSurface(src);
+	SDL_LockSurface(dst);
+	for (int y = 0; y < dst->h; y++) {
+		int y0 = 2 * y < src->h ? 2 * y : src->h - 1;
+		int y1 = y0 + 1 < src->h ? y0 + 1 : y0;
+		const unsigned char *row0 =
+			(const unsigned char *)src->pixels + y0 * src->pitch;
+		const unsigned char *row1 =
+			(const unsigned char *)src->pixels + y1 * src->pitch;
+		unsigned char *out = (unsigned char *)dst->pixels +
+			y * dst->pitch;
+		for (int x = 0; x < dst->w; x++) {
+			int x0 = 2 * x < src->w ? 2 * x : src->w - 1;
+			int x1 = x0 + 1 < src->w ? x0 + 1 : x0;
+			for (int c = 0; c < 4; c++) {
+				out[4 * x + c] = (row0[4 * x0 + c] +
+						  row0[4 * x1 + c] +
+						  row1[4 * x0 + c] +
+						  row1[4 * x1 + c] + 2) >> 2;
+			}
+		}
+	}
+	SDL_UnlockSurface(dst);
+	SDL_UnlockSurface(src);
+}
+
+// Rebuilds only the stale levels up to the one requested, leaving
+// coarser ones stale until they are needed.
+static void update_rendering_tile(const struct world *w, int x, int y,
+				  int level)
+{
+	struct rendering_tile *rtile = &rendering_grid[y][x];
+	int wanted = (2 << level) - 1;
+	int stale = rtile->needs_update & wanted;
+	if (!stale && rtile->texture && rtile->texture_level == level) {
+		return;
+	}
+	if (stale & 1) {
+		draw_rendering_tile(w, rtile, x, y);
+	}
+	for (int l = 1; l <= level; l++) {
+		if (stale & (1 << l)) {
+			downsample(rtile->surfaces[l - 1], rtile->surfaces[l]);
 		}
 	}
+	rtile->needs_update &= ~wanted;
+	if (rtile->texture) {
+		SDL_DestroyTexture(rtile->texture);
+	}
+	rtile->texture = SDL_CreateTextureFromSurface(renderer,
+						      rtile->surfaces[level]);
+	rtile->texture_level = level;
+}
+
+// The finest level with at least as many texels as screen pixels.
+static int lod_level()
+{
+	int level = 0;
+	while (level + 1 < RENDER_LOD_LEVELS &&
+	       camera.zoom <= 1.0f / (2 << level)) {
+		level++;
+	}
+	return level;
+}
+
+static SDL_FRect camera_rect(float x, float y, float w, float h)
+{
+	return (SDL_FRect){
+		(x - camera.x) * camera.zoom,
+		(y - camera.y) * camera.zoom,
+		w * camera.zoom,
+		h * camera.zoom,
+	};
 }
 
-static void render_grid()
+// Chunks off screen give up their textures, so texture memory is bounded
+// by what fits in the window.
+static void render_grid(const struct world *w)
 {
+	int level = lod_level();
 	for (int y = 0; y < RGRID_HEIGHT; y++) {
 		for (int x = 0; x < RGRID_WIDTH; x++) {
 			struct rendering_tile *rtile = &rendering_grid[y][x];
-			SDL_Rect rect = { x * RCELL_WIDTH * CELL_WIDTH,
-					  y * RCELL_HEIGHT * CELL_HEIGHT,
-					  RCELL_WIDTH * CELL_WIDTH,
-					  RCELL_HEIGHT * CELL_HEIGHT };
-			SDL_RenderCopy(renderer, rtile->texture, 0, &rect);
+			SDL_FRect rect = camera_rect(x * CHUNK_WIDTH,
+						     y * CHUNK_HEIGHT,
+						     CHUNK_WIDTH,
+						     CHUNK_HEIGHT);
+			if (rect.x >= WINDOW_WIDTH || rect.y >= WINDOW_HEIGHT ||
+			    rect.x + rect.w <= 0 || rect.y + rect.h <= 0) {
+				if (rtile->texture) {
+					SDL_DestroyTexture(rtile->texture);
+					rtile->texture = 0;
+				}
+				continue;
+			}
+			update_rendering_tile(w, x, y, level);
+			SDL_RenderCopyF(renderer, rtile->texture, 0, &rect);
 		}
 	}
 }
@@ -198,11 +446,8 @@ static void compile_menu(struct compiled_menu *cm, struct menu *m)
 	cm->w = 0;
 	for (int i = 0; i < m->num_entries; i++) {
 		struct menu_entry *e = &m->entries[i];
-		// TODO(cmgn): Only re-draw when at least one of the callbacks
-		// change the text.
 		if (e->callback) {
 			e->text = e->callback();
-			cm->dynamic = 1;
 		}
 		int e_width = strlen(e->text) * 8 * m->font_size;
 		if (e_width > cm->w) {
@@ -211,116 +456,55 @@ static void compile_menu(struct compiled_menu *cm, struct menu *m)
 	}
 	cm->w += m->border_size * 2;
 	cm->w += m->padding * 2;
-	SDL_Surface *surface = SDL_CreateRGBSurface(0, cm->w, cm->h, 32,
-						    0, 0, 0, 0);
-	if (!surface) {
-		SDL_Log("Failed to create menu surface: %s", SDL_GetError());
-		exit(1);
-	}
-	SDL_FillRect(surface, 0, sdl_color_to_uint32(&m->border));
+	hud_push_rect(m->x, m->y, cm->w, cm->h, m->border);
 	for (int i = 0; i < m->num_entries; i++) {
 		struct menu_entry *e = &m->entries[i];
-		int x_off = m->border_size;
-		int y_off = i * m->font_size * 8;
+		int x_off = m->x + m->border_size;
+		int y_off = m->y + i * m->font_size * 8;
 		y_off += (i + 1) * m->border_size;
 		y_off += m->padding * i * 2;
-		SDL_Rect rect = { x_off, y_off, cm->w - 2 * m->border_size,
-				  m->font_size * 8 + 2 * m->padding };
-		SDL_FillRect(surface, &rect,
-			     sdl_color_to_uint32(&m->background));
-		write_text(surface, x_off + m->padding, y_off + m->padding,
-			   e->text, m->font_size, &m->foreground);
-	}
-	SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-	if (!texture) {
-		SDL_Log("Failed to create menu texture: %s", SDL_GetError());
-		exit(1);
+		hud_push_rect(x_off, y_off, cm->w - 2 * m->border_size,
+			      m->font_size * 8 + 2 * m->padding, m->background);
+		write_text(x_off + m->padding, y_off + m->padding, e->text,
+			   m->font_size, m->foreground);
 	}
-	SDL_FreeSurface(surface);
-	cm->texture = texture;
 }
 
-
 static void render_menus()
 {
 	for (int i = 0; i < num_menus; i++) {
 		struct compiled_menu *cm = &menus[i];
-		if (cm->dynamic) {
-			SDL_DestroyTexture(cm->texture);
-			compile_menu(cm, cm->menu);
-		}
-		SDL_Rect rect = { cm->menu->x, cm->menu->y, cm->w, cm->h };
-		SDL_RenderCopy(renderer, cm->texture, 0, &rect);
-	}
-}
-
-static void draw_line_gradual(SDL_Surface *surface, int x0, int y0, int x1, int y1,
-			      unsigned int color, int width)
-{
-	int dx = x1 - x0;
-	int dy = y1 - y0;
-	int yi = 1;
-	if (dy < 0) {
-		yi = -1;
-		dy = -dy;
-	}
-	int d = 2*dy - dx;
-	int y = y0;
-	for (int x = x0; x <= x1; x++) {
-		SDL_Rect r = { x, y, width, width };
-		SDL_FillRect(surface, &r, color);
-		if (d > 0) {
-			y += yi;
-			d += 2 * (dy - dx);
-		} else {
-			d += 2 * dy;
-		}
-	}
-}
-
-static void draw_line_steep(SDL_Surface *surface, int x0, int y0, int x1, int y1,
-			    unsigned int color, int width)
-{
-	int dx = x1 - x0;
-	int dy = y1 - y0;
-	int xi = 1;
-	if (dx < 0) {
-		xi = -1;
-		dx = -dx;
-	}
-	int d = 2*dx - dy;
-	int x = x0;
-	for (int y = y0; y <= y1; y++) {
-		SDL_Rect r = { x, y, width, width };
-		SDL_FillRect(surface, &r, color);
-		if (d > 0) {
-			x += xi;
-			d += 2 * (dx - dy);
-		} else {
-			d += 2 * dx;
-		}
+		compile_menu(cm, cm->menu);
 	}
 }
 
-static void draw_line(SDL_Surface *surface, int x0, int y0, int x1, int y1,
-		      unsigned int color, int width)
+// Lines are emitted as quads of the given width, offset like the
+// width-sized squares the old rasterizer stamped along the line.
+static void draw_line(float x0, float y0, float x1, float y1, SDL_Color color,
+		      int width)
 {
-	if (abs(y1 - y0) < abs(x1 - x0)) {
-		if (x0 > x1) {
-			draw_line_gradual(surface, x1, y1, x0, y0, color, width);
-		} else {
-			draw_line_gradual(surface, x0, y0, x1, y1, color, width);
-		}
-	} else {
-		if (y0 > y1) {
-			draw_line_steep(surface, x1, y1, x0, y0, color, width);
-		} else {
-			draw_line_steep(surface, x0, y0, x1, y1, color, width);
-		}
+	float dx = x1 - x0;
+	float dy = y1 - y0;
+	float length = sqrtf(dx * dx + dy * dy);
+	if (length == 0) {
+		return;
 	}
+	float nx = -dy / length * width / 2;
+	float ny = dx / length * width / 2;
+	x0 += width / 2.0f;
+	y0 += width / 2.0f;
+	x1 += width / 2.0f;
+	y1 += width / 2.0f;
+	SDL_FPoint pos[4] = { { x0 + nx, y0 + ny }, { x1 + nx, y1 + ny },
+			      { x1 - nx, y1 - ny }, { x0 - nx, y0 - ny } };
+	SDL_FPoint uv[4] = { { HUD_SOLID_U, HUD_SOLID_V },
+			     { HUD_SOLID_U, HUD_SOLID_V },
+			     { HUD_SOLID_U, HUD_SOLID_V },
+			     { HUD_SOLID_U, HUD_SOLID_V } };
+	hud_push_quad(pos, uv, color);
 }
 
-static void draw_graph_data(struct graph *g, SDL_Surface *surface)
+static void draw_graph_data(struct graph *g)
 {
 	float min_y = g->values[0];
 	float max_y = g->values[0];
@@ -332,68 +516,97 @@ static void draw_graph_data(struct graph *g, SDL_Surface *surface)
 			max_y = g->values[i];
 		}
 	}
+	float range = fabs(max_y - min_y);
+	if (range == 0) {
+		range = 1;
+	}
 	int w = g->w - 4 * GRAPH_PADDING;
 	int h = g->h - 4 * GRAPH_PADDING;
 	int x_step = w/(g->num_values - 1);
 	int x_offset = 3 * GRAPH_PADDING;
 	int prev_x = x_offset;
-	int prev_y = h * ((g->values[0] - min_y) / fabs(max_y - min_y));
+	int prev_y = h * ((g->values[0] - min_y) / range);
 	prev_y = g->h - prev_y - 3 * GRAPH_PADDING;
 	for (int i = 1; i < g->num_values; i++) {
 		int x = x_offset + x_step * i;
-		int y = h * ((g->values[i] - min_y) / fabs(max_y - min_y));
+		int y = h * ((g->values[i] - min_y) / range);
 		y = g->h - y - 3 * GRAPH_PADDING;
-		draw_line(surface, prev_x, prev_y, x, y, GRAPH_LN_COLOR,
-			  GRAPH_LINE_WIDTH);
+		draw_line(g->x + prev_x, g->y + prev_y, g->x + x, g->y + y,
+			  GRAPH_LN_COLOR, GRAPH_LINE_WIDTH);
 		prev_x = x;
 		prev_y = y;
 	}
 }
 
-static void compile_graph(struct compiled_graph *cg, struct graph *g)
+static void compile_graph(struct graph *g)
 {
-	SDL_Surface *surface = SDL_CreateRGBSurface(0, g->w, g->h,
-						    32, 0, 0, 0, 0);
-	if (!surface) {
-		SDL_Log("Failed to create graph surface: %s", SDL_GetError());
-		exit(1);
-	}
-	SDL_FillRect(surface, 0, GRAPH_BG_COLOR);
-	SDL_Rect x_axis = { GRAPH_PADDING, GRAPH_PADDING, GRAPH_PADDING,
-			    g->h - 2 * GRAPH_PADDING };
-	SDL_FillRect(surface, &x_axis, GRAPH_FG_COLOR);
-	SDL_Rect y_axis= { GRAPH_PADDING, g->h - 2 * GRAPH_PADDING,
-			   g->w - 2 * GRAPH_PADDING, GRAPH_PADDING };
-	SDL_FillRect(surface, &y_axis, GRAPH_FG_COLOR);
+	hud_push_rect(g->x, g->y, g->w, g->h, GRAPH_BG_COLOR);
+	hud_push_rect(g->x + GRAPH_PADDING, g->y + GRAPH_PADDING,
+		      GRAPH_PADDING, g->h - 2 * GRAPH_PADDING, GRAPH_FG_COLOR);
+	hud_push_rect(g->x + GRAPH_PADDING, g->y + g->h - 2 * GRAPH_PADDING,
+		      g->w - 2 * GRAPH_PADDING, GRAPH_PADDING, GRAPH_FG_COLOR);
 	if (g->num_values > 1) {
-		draw_graph_data(g, surface);
-	}
-	SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-	if (!texture) {
-		SDL_Log("Failed to create graph texture: %s", SDL_GetError());
-		exit(1);
+		draw_graph_data(g);
 	}
-	SDL_FreeSurface(surface);
-	cg->graph = g;
-	cg->texture = texture;
 }
 
 static void render_graphs()
 {
 	for (int i = 0; i < num_graphs; i++) {
-		struct compiled_graph *cg = &graphs[i];
-		struct graph *g = cg->graph;
-		SDL_Rect r = { g->x, g->y, g->w, g->h };
-		SDL_RenderCopy(renderer, cg->texture, 0, &r);
+		compile_graph(graphs[i]);
 	}
 }
 
-void render()
+static void render_hud()
 {
-	update_rendering_grid();
-	render_grid();
+	hud.num_quads = 0;
 	render_menus();
 	render_graphs();
+	if (hud.num_quads > 0) {
+		SDL_RenderGeometry(renderer, hud_atlas, hud.vertices,
+				   hud.num_quads * 4, hud.indices,
+				   hud.num_quads * 6);
+	}
+}
+
+/*
+ * One texel per tile; the GPU scales the texture up over the whole map.
+ * Tiles are coloured as they change, so a frame costs at most one upload
+ * of the whole buffer, and nothing if no tile changed.
+ */
+static void render_overlay()
+{
+	if (!overlay_shown) {
+		return;
+	}
+	if (overlay_dirty) {
+		SDL_UpdateTexture(overlay_texture, 0, overlay_pixels,
+				  GRID_WIDTH * sizeof(*overlay_pixels));
+		overlay_dirty = 0;
+	}
+	SDL_FRect rect = camera_rect(0, 0, GRID_WIDTH * CELL_WIDTH,
+				     GRID_HEIGHT * CELL_HEIGHT);
+	SDL_RenderCopyF(renderer, overlay_texture, 0, &rect);
+}
+
+void render(const struct world *w)
+{
+	render_grid(w);
+	render_overlay();
+	render_hud();
+}
+
+void render_show_overlay(int shown)
+{
+	overlay_shown = shown;
+}
+
+void render_overlay_tile(int x, int y, float value)
+{
+	value = value < 0 ? 0 : value > 1 ? 1 : value;
+	overlay_pixels[y * GRID_WIDTH + x] =
+		overlay_lut[(int)(value * (OVERLAY_LUT_SIZE - 1))];
+	overlay_dirty = 1;
 }
 
 
@@ -401,27 +614,49 @@ void render_mark_tile(int x, int y)
 {
 	x /= RCELL_WIDTH;
 	y /= RCELL_HEIGHT;
-	rendering_grid[y][x].needs_update = 1;
+	rendering_grid[y][x].needs_update = RENDER_ALL_LEVELS;
+}
+
+// Keeps the map point under the given window position fixed.
+void render_zoom(float factor, int screen_x, int screen_y)
+{
+	float zoom = camera.zoom * factor;
+	zoom = zoom < MIN_ZOOM ? MIN_ZOOM : zoom > MAX_ZOOM ? MAX_ZOOM : zoom;
+	float map_x = camera.x + screen_x / camera.zoom;
+	float map_y = camera.y + screen_y / camera.zoom;
+	camera.zoom = zoom;
+	camera.x = map_x - screen_x / zoom;
+	camera.y = map_y - screen_y / zoom;
+}
+
+void render_pan(int dx, int dy)
+{
+	camera.x += dx / camera.zoom;
+	camera.y += dy / camera.zoom;
+}
+
+void render_screen_to_tile(int screen_x, int screen_y, int *x, int *y)
+{
+	*x = floorf((camera.x + screen_x / camera.zoom) / CELL_WIDTH);
+	*y = floorf((camera.y + screen_y / camera.zoom) / CELL_HEIGHT);
 }
 
 void render_push_menu(struct menu *m)
 {
-	compile_menu(&menus[num_menus++], m);
+	menus[num_menus++].menu = m;
 }
 
 void render_pop_menu()
 {
 	num_menus--;
-	SDL_DestroyTexture(menus[num_menus].texture);
 }
 
 void render_push_graph(struct graph *g)
 {
-	compile_graph(&graphs[num_graphs++], g);
+	graphs[num_graphs++] = g;
 }
 
 void render_pop_graph()
 {
 	num_graphs--;
-	SDL_DestroyTexture(graphs[num_graphs].texture);
 }
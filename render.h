@@ -2,6 +2,7 @@
 #define _RENDER_H
 
 struct menu;
+struct world;
 
 struct graph {
 	int x;
@@ -13,10 +14,21 @@ struct graph {
 };
 
 extern int init_render();
-extern void render();
+extern void render(const struct world *w);
 
 extern void render_mark_tile(int x, int y);
 
+// The camera: the mouse wheel zooms about the cursor and dragging pans,
+// both in window pixels.
+extern void render_zoom(float factor, int screen_x, int screen_y);
+extern void render_pan(int dx, int dy);
+extern void render_screen_to_tile(int screen_x, int screen_y, int *x, int *y);
+
+// Overlay values are in [0, 1] and are kept until the tile is set again,
+// whether or not the overlay is shown.
+extern void render_show_overlay(int shown);
+extern void render_overlay_tile(int x, int y, float value);
+
 extern void render_push_menu(struct menu *m);
 extern void render_pop_menu();
 
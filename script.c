@@ -0,0 +1,361 @@
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include <SDL2/SDL.h>
+
+#include "game.h"
+#include "script.h"
+
+// POSIX only promises 16; Linux and macOS allow 1024.
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
+/*
+ * Requests are read and answered on a thread of their own so that a slow
+ * client never stalls the tick loop. The only state that thread shares
+ * with the simulation is the step counter, the published stats, the edit
+ * queue and, for snapshots, the grid itself.
+ */
+struct script {
+	struct world *world;
+	const char *socket_path;
+	int listen_fd;
+	int in_fd;
+	int out_fd;
+	SDL_Thread *thread;
+	SDL_atomic_t steps;
+	SDL_sem *stepped;
+	SDL_atomic_t generation;
+	SDL_atomic_t closed;
+	SDL_SpinLock stats_lock;
+	struct script_stats stats;
+};
+
+static struct script script = { .listen_fd = -1, .in_fd = -1 };
+
+static int read_full(int fd, void *data, size_t size)
+{
+	char *p = data;
+	while (size > 0) {
+		ssize_t n = read(fd, p, size);
+		if (n <= 0) {
+			return -1;
+		}
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+// A client that hangs up mid-reply makes the write fail with EPIPE, which
+// ends its session like any other error.
+static int write_full(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+	while (size > 0) {
+		ssize_t n = write(fd, p, size);
+		if (n <= 0) {
+			return -1;
+		}
+		p += n;
+		size -= n;
+	}
+	return 0;
+}
+
+// Writes no more than IOV_MAX buffers per call and picks up where a
+// partial write left off. The iovecs are consumed as it goes.
+static int writev_full(int fd, struct iovec *iov, int count)
+{
+	while (count > 0) {
+		ssize_t n = writev(fd, iov, count < IOV_MAX ? count : IOV_MAX);
+		if (n <= 0) {
+			return -1;
+		}
+		while (count > 0 && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (n > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+static int reply(int status, const void *payload, int length)
+{
+	struct script_reply r = {
+		.status = status,
+		.generation = SDL_AtomicGet(&script.generation),
+		.length = length,
+	};
+	if (write_full(script.out_fd, &r, sizeof(r)) < 0) {
+		return -1;
+	}
+	return write_full(script.out_fd, payload, length);
+}
+
+static int step(int ticks)
+{
+	if (ticks <= 0) {
+		return reply(-1, 0, 0);
+	}
+	SDL_AtomicAdd(&script.steps, ticks);
+	SDL_SemWait(script.stepped);
+	return reply(0, 0, 0);
+}
+
+static int stats()
+{
+	struct script_stats s;
+	SDL_AtomicLock(&script.stats_lock);
+	s = script.stats;
+	SDL_AtomicUnlock(&script.stats_lock);
+	return reply(0, &s, sizeof(s));
+}
+
+static int edit(const int32_t *args)
+{
+	struct edit e = {
+		.type = args[0],
+		.x = args[1],
+		.y = args[2],
+		.value = args[3],
+	};
+	return reply(simulate_edit(script.world, &e), 0, 0);
+}
+
+/*
+ * Rows go straight from the grid to the socket, without a copy. Nothing
+ * stops a tick from running meanwhile, so the reply is bracketed by the
+ * generation and the client retries if the two differ.
+ */
+static int snapshot(const int32_t *args)
+{
+	int x = args[0];
+	int y = args[1];
+	int w = args[2];
+	int h = args[3];
+	if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > GRID_WIDTH ||
+	    y + h > GRID_HEIGHT) {
+		return reply(-1, 0, 0);
+	}
+	struct iovec iov[GRID_HEIGHT];
+	struct script_reply r = {
+		.generation = SDL_AtomicGet(&script.generation),
+		.length = w * h * sizeof(struct tile) + sizeof(int32_t),
+	};
+	for (int row = 0; row < h; row++) {
+		iov[row] = (struct iovec){
+			&script.world->grid[y + row][x],
+			w * sizeof(struct tile),
+		};
+	}
+	if (write_full(script.out_fd, &r, sizeof(r)) < 0 ||
+	    writev_full(script.out_fd, iov, h) < 0) {
+		return -1;
+	}
+	int32_t generation = SDL_AtomicGet(&script.generation);
+	return write_full(script.out_fd, &generation, sizeof(generation));
+}
+
+/*
+ * Unlike a snapshot, a region query is small enough to retry here until
+ * it lands between ticks, so the client always gets a consistent sum.
+ */
+static int region(int op, const int32_t *args)
+{
+	if (op == SCRIPT_REGION ? args[2] < 0 || args[3] < 0 : args[2] < 0) {
+		return reply(-1, 0, 0);
+	}
+	struct region r;
+	int generation;
+	for (;;) {
+		generation = SDL_AtomicGet(&script.generation);
+		if (generation & 1) {
+			SDL_Delay(1);
+			continue;
+		}
+		if (op == SCRIPT_REGION) {
+			summary_rect(&script.world->summary, args[0], args[1],
+				     args[2], args[3], &r);
+		} else {
+			summary_radius(&script.world->summary, args[0],
+				       args[1], args[2], &r);
+		}
+		if (SDL_AtomicGet(&script.generation) == generation) {
+			break;
+		}
+	}
+	struct script_region out = { .occupants = r.occupants };
+	for (int i = 0; i < TILE_TYPE_COUNT; i++) {
+		out.tiles[i] = r.tiles[i];
+	}
+	return reply(0, &out, sizeof(out));
+}
+
+static int serve_request(const struct script_request *req)
+{
+	switch (req->op) {
+	case SCRIPT_STEP:
+		return step(req->args[0]);
+	case SCRIPT_STATS:
+		return stats();
+	case SCRIPT_EDIT:
+		return edit(req->args);
+	case SCRIPT_SNAPSHOT:
+		return snapshot(req->args);
+	case SCRIPT_REGION:
+	case SCRIPT_RADIUS:
+		return region(req->op, req->args);
+	case SCRIPT_QUIT:
+		reply(0, 0, 0);
+		SDL_AtomicSet(&script.closed, 1);
+		return -1;
+	}
+	return reply(-1, 0, 0);
+}
+
+static void serve(int in_fd, int out_fd)
+{
+	script.out_fd = out_fd;
+	struct script_request req;
+	while (read_full(in_fd, &req, sizeof(req)) == 0) {
+		if (serve_request(&req) < 0) {
+			break;
+		}
+	}
+}
+
+// Socket clients are served one at a time, so a harness can reconnect
+// to the same warm process for each study.
+static int script_thread(void *data)
+{
+	if (script.listen_fd < 0) {
+		serve(STDIN_FILENO, STDOUT_FILENO);
+	} else {
+		int fd;
+		while (!script_closed() &&
+		       (fd = accept(script.listen_fd, 0, 0)) >= 0) {
+			serve(fd, fd);
+			close(fd);
+		}
+	}
+	SDL_AtomicSet(&script.closed, 1);
+	return 0;
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		SDL_Log("Socket path too long: %s", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		SDL_Log("Failed to create socket");
+		return -1;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(fd, 1) < 0) {
+		SDL_Log("Failed to listen on %s", path);
+		close(fd);
+		return -1;
+	}
+	script.socket_path = path;
+	return fd;
+}
+
+int init_script(const char *path, struct world *w)
+{
+	script.world = w;
+	// Otherwise a client hanging up before its reply kills the process.
+	signal(SIGPIPE, SIG_IGN);
+	if (strcmp(path, "-") != 0) {
+		script.listen_fd = listen_on(path);
+		if (script.listen_fd < 0) {
+			return -1;
+		}
+	}
+	script.stepped = SDL_CreateSemaphore(0);
+	if (!script.stepped) {
+		SDL_Log("Failed to create script semaphore: %s",
+			SDL_GetError());
+		return -1;
+	}
+	script_end_ticks(w, 0);
+	script.thread = SDL_CreateThread(script_thread, "script", 0);
+	if (!script.thread) {
+		SDL_Log("Failed to start script thread: %s", SDL_GetError());
+		return -1;
+	}
+	// It may be blocked in read() or accept() when the game exits.
+	SDL_DetachThread(script.thread);
+	return 0;
+}
+
+int script_attached()
+{
+	return script.thread != 0;
+}
+
+int script_closed()
+{
+	return SDL_AtomicGet(&script.closed);
+}
+
+int script_steps()
+{
+	return SDL_AtomicGet(&script.steps);
+}
+
+void script_begin_ticks()
+{
+	SDL_AtomicAdd(&script.generation, 1);
+}
+
+// Publishes stats at a tick boundary and answers the pending step
+// request once all of its ticks have run.
+void script_end_ticks(const struct world *w, int ticks)
+{
+	struct script_stats s = {
+		.tick = w->tick,
+		.population = w->population,
+		.emigration = w->emigration,
+		.employment = w->employment,
+		.houses = w->num_houses,
+		.vacancies = w->num_vacancies,
+	};
+	SDL_AtomicLock(&script.stats_lock);
+	script.stats = s;
+	SDL_AtomicUnlock(&script.stats_lock);
+	if (ticks == 0) {
+		return;
+	}
+	SDL_AtomicAdd(&script.generation, 1);
+	if (SDL_AtomicAdd(&script.steps, -ticks) == ticks) {
+		SDL_SemPost(script.stepped);
+	}
+}
+
+void finish_script()
+{
+	if (!script.thread) {
+		return;
+	}
+	if (script.listen_fd >= 0) {
+		close(script.listen_fd);
+		unlink(script.socket_path);
+	}
+}
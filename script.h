@@ -0,0 +1,73 @@
+#ifndef _SCRIPT_H
+#define _SCRIPT_H
+
+#include <stdint.h>
+
+#include "simulate.h"
+
+/*
+ * A binary request/reply protocol for driving the simulation from another
+ * process, over stdin/stdout or a Unix domain socket. Every request is
+ * one struct script_request and is answered by one struct script_reply
+ * followed by length bytes of payload. All fields are in host byte order.
+ *
+ * While a script is attached the world only advances on SCRIPT_STEP. A
+ * headless game exits on SCRIPT_QUIT, or when stdin closes.
+ */
+enum script_op {
+	// args: ticks. Replies once the ticks have run.
+	SCRIPT_STEP,
+	// Payload: struct script_stats.
+	SCRIPT_STATS,
+	// args: edit type, x, y, value. Applied at the next tick.
+	SCRIPT_EDIT,
+	// args: x, y, width, height. Payload: the rows of struct tile in
+	// the region, then the generation once more as an int32_t.
+	SCRIPT_SNAPSHOT,
+	// args: x, y, width, height. Payload: struct script_region. The
+	// part outside the grid counts for nothing; negative sizes fail.
+	SCRIPT_REGION,
+	// args: x, y, radius. Payload: struct script_region. Likewise.
+	SCRIPT_RADIUS,
+	// Ends the run once replied to. Socket clients may otherwise come
+	// and go, so this is how a headless game on a socket is stopped.
+	SCRIPT_QUIT,
+};
+
+struct script_request {
+	int32_t op;
+	int32_t args[4];
+};
+
+// The generation is odd while a tick is running. A snapshot whose
+// generation is odd or differs from its trailer may be torn.
+struct script_reply {
+	int32_t status;
+	int32_t generation;
+	int32_t length;
+};
+
+struct script_stats {
+	int32_t tick;
+	int32_t population;
+	int32_t emigration;
+	int32_t employment;
+	int32_t houses;
+	int32_t vacancies;
+};
+
+struct script_region {
+	int32_t tiles[TILE_TYPE_COUNT];
+	int32_t occupants;
+};
+
+// A path of "-" serves the protocol on stdin and stdout.
+extern int init_script(const char *path, struct world *w);
+extern int script_attached();
+extern int script_closed();
+extern int script_steps();
+extern void script_begin_ticks();
+extern void script_end_ticks(const struct world *w, int ticks);
+extern void finish_script();
+
+#endif
@@ -6,64 +6,120 @@
 #include "simulate.h"
 #include "render.h"
 
-#define POPULATION_RETENTION 128
 #define SAMPLE_FREQUENCY 5
 
-int population = 0;
-int emigration = 0;
+// Per-tick chances of a child moving out and of a birth. A house draws one
+// candidate event at the combined rate, and each event picks one of the
+// two uniformly; see schedule_house().
+#define LEAVE_CHANCE 0.01
+#define BIRTH_CHANCE 0.01
+#define HOUSE_EVENT_CHANCE ((LEAVE_CHANCE) + (BIRTH_CHANCE))
 
-struct house {
-	int adults;
-	int children;
+// Desirability scales a house lot's develop chance by at most this much.
+#define MAX_DESIRABILITY 2
+
+/*
+ * Each developed tile type has its own rules: the chance an empty lot
+ * zoned for it develops on a tick, how to allocate its state, and a
+ * pass run once per tick over that type's dense state array.
+ */
+struct tile_rules {
+	float develop_chance;
+	int (*build)(struct world *w, int x, int y);
+	void (*update)(struct world *w);
+	enum workplace_kind workplace;
+	int jobs;
+	float hire_chance;
 };
 
-static struct house houses[GRID_WIDTH * GRID_HEIGHT];
-static int num_houses = 0;
+static void mark_tile_dirty(struct world *w, int x, int y)
+{
+	int i = y * GRID_WIDTH + x;
+	if ((w->options & WORLD_HISTORY) && !w->tile_dirty[i]) {
+		w->tile_dirty[i] = 1;
+		w->dirty_tiles[w->num_dirty_tiles++] = i;
+	}
+}
+
+static void mark_overlay_tile(struct world *w, int i)
+{
+	if ((w->options & WORLD_RENDERED) && !w->overlay_tile_dirty[i]) {
+		w->overlay_tile_dirty[i] = 1;
+		w->overlay_tiles[w->num_overlay_tiles++] = i;
+	}
+}
+
+static void mark_house_dirty(struct world *w, int i)
+{
+	if ((w->options & WORLD_HISTORY) && !w->house_dirty[i]) {
+		w->house_dirty[i] = 1;
+		w->dirty_houses[w->num_dirty_houses++] = i;
+	}
+}
+
+static void update_frontier(struct world *w, int x, int y);
 
-static int sample_clock = 0;
+static void update_tile(struct world *w, int x, int y, enum tile_type type)
+{
+	mark_tile_dirty(w, x, y);
+	mark_overlay_tile(w, y * GRID_WIDTH + x);
+	summary_add(&w->summary, w->grid[y][x].type, x, y, -1);
+	summary_add(&w->summary, type, x, y, 1);
+	w->grid[y][x].type = type;
+	if (w->options & WORLD_RENDERED) {
+		render_mark_tile(x, y);
+	}
+	field_mark_tile(&w->fields, x, y, type);
+	update_frontier(w, x, y);
+}
 
-static float population_samples[POPULATION_RETENTION] = { 0 };
-static int num_population_samples = 0;
-static struct graph population_graph = { 0 };
+// xorshift64*, one stream per world so runs are reproducible per seed.
+static unsigned int random_next(struct world *w)
+{
+	w->rng ^= w->rng >> 12;
+	w->rng ^= w->rng << 25;
+	w->rng ^= w->rng >> 27;
+	return (w->rng * 0x2545F4914F6CDD1DULL) >> 32;
+}
 
-static void update_tile(int x, int y, enum tile_type type)
+static float random_float(struct world *w)
 {
-	grid[y][x].type = type;
-	render_mark_tile(x, y);
+	return (random_next(w) >> 8) * (1.0f / (1 << 24));
 }
 
-static float random_float()
+static int random_int(struct world *w, int n)
 {
-	return (float)rand() / (float)RAND_MAX;
+	return random_next(w) % n;
 }
 
-#define CHANCE(P) ((random_float()) < (P))
+#define CHANCE(W, P) ((random_float(W)) < (P))
 
 static int in_grid(int x, int y)
 {
 	return x >= 0 && x < GRID_WIDTH && y >= 0 && y < GRID_HEIGHT;
 }
 
-static void place_random_lake_step(int x, int y, float probability)
+static void place_random_lake_step(struct world *w, int x, int y,
+				   float probability)
 {
-	if (random_float() > probability) {
+	if (random_float(w) > probability) {
 		return;
 	}
-	if (!in_grid(x, y) || grid[y][x].type == TILE_WATER) {
+	if (!in_grid(x, y) || w->grid[y][x].type == TILE_WATER) {
 		return;
 	}
-	update_tile(x, y, TILE_WATER);
-	place_random_lake_step(x - 1, y, probability * 0.875);
-	place_random_lake_step(x + 1, y, probability * 0.875);
-	place_random_lake_step(x, y - 1, probability * 0.875);
-	place_random_lake_step(x, y + 1, probability * 0.875);
+	update_tile(w, x, y, TILE_WATER);
+	place_random_lake_step(w, x - 1, y, probability * 0.875);
+	place_random_lake_step(w, x + 1, y, probability * 0.875);
+	place_random_lake_step(w, x, y - 1, probability * 0.875);
+	place_random_lake_step(w, x, y + 1, probability * 0.875);
 }
 
-static void place_random_lake()
+static void place_random_lake(struct world *w)
 {
-	int x = rand() % GRID_WIDTH;
-	int y = rand() % GRID_HEIGHT;
-	place_random_lake_step(x, y, 1.0f);
+	int x = random_int(w, GRID_WIDTH);
+	int y = random_int(w, GRID_HEIGHT);
+	place_random_lake_step(w, x, y, 1.0f);
 }
 
 static float euclidean_distance(int x1, int y1, int x2, int y2)
@@ -79,7 +135,7 @@ static void swap(void *a, void *b, int size)
 	memcpy(b, buf, size);
 }
 
-static void draw_road(int x1, int y1, int x2, int y2)
+static void draw_road(struct world *w, int x1, int y1, int x2, int y2)
 {
 	if (x1 > x2) {
 		swap(&x1, &x2, sizeof(x1));
@@ -88,27 +144,27 @@ static void draw_road(int x1, int y1, int x2, int y2)
 		swap(&y1, &y2, sizeof(y1));
 	}
 	for (int x = x1; x <= x2; x++) {
-		update_tile(y1, x, TILE_ROAD);
+		update_tile(w, y1, x, TILE_ROAD);
 	}
 	for (int y = y1; y <= y2; y++) {
-		update_tile(y, x2, TILE_ROAD);
+		update_tile(w, y, x2, TILE_ROAD);
 	}
 }
 
-static void place_random_road()
+static void place_random_road(struct world *w)
 {
-	int x1 = rand() % GRID_WIDTH;
-	int y1 = rand() % GRID_HEIGHT;
+	int x1 = random_int(w, GRID_WIDTH);
+	int y1 = random_int(w, GRID_HEIGHT);
 	int x2;
 	int y2;
 	do {
-		x2 = rand() % GRID_WIDTH;
-		y2 = rand() % GRID_HEIGHT;
+		x2 = random_int(w, GRID_WIDTH);
+		y2 = random_int(w, GRID_HEIGHT);
 	} while (euclidean_distance(x1, y1, x2, y2) < 8);
-	draw_road(x1, y1, x2, y2);
+	draw_road(w, x1, y1, x2, y2);
 }
 
-static int has_neighbouring_road(int x, int y)
+static int has_neighbouring_road(const struct world *w, int x, int y)
 {
 	struct { int dx, dy; } deltas[] = {
 		{ -1, +0 }, { +1, +0 },
@@ -118,106 +174,667 @@ static int has_neighbouring_road(int x, int y)
 	for (int i = 0; i < num_deltas; i++) {
 		int x1 = x + deltas[i].dx;
 		int y1 = y + deltas[i].dy;
-		if (in_grid(x1, y1) && grid[y1][x1].type == TILE_ROAD) {
+		if (in_grid(x1, y1) && w->grid[y1][x1].type == TILE_ROAD) {
 			return 1;
 		}
 	}
 	return 0;
 }
 
-static int build_house(int x, int y)
+// Ticks until the first success of a trial with chance p per tick.
+static int geometric_delay(struct world *w, float p)
 {
-	update_tile(x, y, TILE_HOUSE);
-	houses[num_houses] = (struct house){ 0 };
-	grid[y][x].house_index = num_houses;
-	return num_houses++;
+	float u = 1 - random_float(w);
+	return 1 + (int)(log(u) / log(1 - p));
 }
 
-static void place_houses_along_road()
+static int house_has_events(const struct house *h)
+{
+	return h->children > 0 || (h->adults == 2 && h->children < 2);
+}
+
+static void file_house(struct world *w, int i)
+{
+	struct house *h = &w->houses[i];
+	int *slot = &w->house_wheel[h->due & (EVENT_WHEEL_SIZE - 1)];
+	h->next_due = *slot;
+	*slot = i;
+}
+
+/*
+ * Instead of rolling the dice for every house on every tick, each house
+ * with something that can happen to it draws the tick of its next
+ * candidate event from a geometric distribution and waits on the timing
+ * wheel until then.
+ */
+static void schedule_house(struct world *w, int i)
+{
+	struct house *h = &w->houses[i];
+	if (h->due >= 0 || !house_has_events(h)) {
+		return;
+	}
+	h->due = w->tick + geometric_delay(w, HOUSE_EVENT_CHANCE);
+	file_house(w, i);
+}
+
+// Houses with room for another adult are kept in an unordered set so
+// migrants can be housed without scanning every house.
+static void update_vacancy(struct world *w, int i)
+{
+	struct house *h = &w->houses[i];
+	if (h->adults < 2 && h->vacancy < 0) {
+		h->vacancy = w->num_vacancies;
+		w->vacancies[w->num_vacancies++] = i;
+	} else if (h->adults == 2 && h->vacancy >= 0) {
+		int last = w->vacancies[--w->num_vacancies];
+		w->vacancies[h->vacancy] = last;
+		w->houses[last].vacancy = h->vacancy;
+		h->vacancy = -1;
+	}
+}
+
+static void house_changed(struct world *w, int i)
+{
+	struct house *h = &w->houses[i];
+	int occupants = h->adults + h->children;
+	summary_add(&w->summary, SUMMARY_OCCUPANTS, h->tile % GRID_WIDTH,
+		    h->tile / GRID_WIDTH, occupants - h->occupants);
+	h->occupants = occupants;
+	mark_house_dirty(w, i);
+	mark_overlay_tile(w, h->tile);
+	update_vacancy(w, i);
+	schedule_house(w, i);
+}
+
+static int build_house(struct world *w, int x, int y)
+{
+	int i = w->num_houses++;
+	w->houses[i] = (struct house){
+		.tile = y * GRID_WIDTH + x,
+		.due = -1,
+		.vacancy = -1,
+	};
+	mark_house_dirty(w, i);
+	update_vacancy(w, i);
+	return i;
+}
+
+static int build_workplace(struct workplace_store *store, int x, int y)
+{
+	store->items[store->count] = (struct workplace){
+		.tile = y * GRID_WIDTH + x,
+	};
+	return store->count++;
+}
+
+static int build_commercial(struct world *w, int x, int y)
+{
+	return build_workplace(&w->workplaces[WORKPLACE_COMMERCIAL], x, y);
+}
+
+static int build_industrial(struct world *w, int x, int y)
+{
+	return build_workplace(&w->workplaces[WORKPLACE_INDUSTRIAL], x, y);
+}
+
+static int build_service(struct world *w, int x, int y)
+{
+	return build_workplace(&w->workplaces[WORKPLACE_SERVICE], x, y);
+}
+
+static void update_houses(struct world *w);
+static void update_commercials(struct world *w);
+static void update_industries(struct world *w);
+static void update_services(struct world *w);
+
+static const struct tile_rules tile_rules[TILE_TYPE_COUNT] = {
+	[TILE_HOUSE] = {
+		.develop_chance = 0.0025,
+		.build = build_house,
+		.update = update_houses,
+	},
+	[TILE_COMMERCIAL] = {
+		.develop_chance = 0.002,
+		.build = build_commercial,
+		.update = update_commercials,
+		.workplace = WORKPLACE_COMMERCIAL,
+		.jobs = 4,
+		.hire_chance = 0.05,
+	},
+	[TILE_INDUSTRIAL] = {
+		.develop_chance = 0.001,
+		.build = build_industrial,
+		.update = update_industries,
+		.workplace = WORKPLACE_INDUSTRIAL,
+		.jobs = 8,
+		.hire_chance = 0.02,
+	},
+	[TILE_SERVICE] = {
+		.develop_chance = 0.0005,
+		.build = build_service,
+		.update = update_services,
+		.workplace = WORKPLACE_SERVICE,
+		.jobs = 2,
+		.hire_chance = 0.05,
+	},
+};
+
+static const enum tile_type zone_tiles[ZONE_TYPE_COUNT] = {
+	[ZONE_NONE]        = TILE_HOUSE,
+	[ZONE_RESIDENTIAL] = TILE_HOUSE,
+	[ZONE_COMMERCIAL]  = TILE_COMMERCIAL,
+	[ZONE_INDUSTRIAL]  = TILE_INDUSTRIAL,
+	[ZONE_SERVICE]     = TILE_SERVICE,
+};
+
+static int build_tile(struct world *w, int x, int y, enum tile_type type)
+{
+	update_tile(w, x, y, type);
+	unsigned short *count = &w->build_counts[y * GRID_WIDTH + x];
+	if (++*count > w->max_build_count) {
+		w->max_build_count = *count;
+	}
+	w->grid[y][x].index = tile_rules[type].build(w, x, y);
+	return w->grid[y][x].index;
+}
+
+static void place_random_zone(struct world *w, enum zone_type zone, int width,
+			      int height)
+{
+	int x0 = random_int(w, GRID_WIDTH - width);
+	int y0 = random_int(w, GRID_HEIGHT - height);
+	for (int y = y0; y < y0 + height; y++) {
+		for (int x = x0; x < x0 + width; x++) {
+			w->grid[y][x].zone = zone;
+		}
+	}
+}
+
+static void place_random_zones(struct world *w)
+{
+	place_random_zone(w, ZONE_COMMERCIAL, 8, 4);
+	place_random_zone(w, ZONE_INDUSTRIAL, 6, 6);
+	place_random_zone(w, ZONE_SERVICE, 3, 3);
+}
+
+// The starting households, on lots zoned for houses only; the other
+// zones are left to develop by their own rules.
+static void place_houses_along_road(struct world *w)
 {
 	for (int y = 0; y < GRID_HEIGHT; y++) {
 		for (int x = 0; x < GRID_WIDTH; x++) {
-			if (grid[y][x].type == TILE_GRASS &&
-			    has_neighbouring_road(x, y) &&
-			    random_float() < 0.15) {
-				houses[build_house(x, y)].adults = 2;
+			if (w->grid[y][x].type == TILE_GRASS &&
+			    zone_tiles[w->grid[y][x].zone] == TILE_HOUSE &&
+			    has_neighbouring_road(w, x, y) &&
+			    random_float(w) < 0.15) {
+				int i = build_tile(w, x, y, TILE_HOUSE);
+				w->houses[i].adults = 2;
+				w->num_adults += 2;
+				w->population += 2;
+				house_changed(w, i);
+				agents_spawn(&w->agents, i, AGENT_HOME,
+					     AGENT_ADULT_AGE);
+				agents_spawn(&w->agents, i, AGENT_HOME,
+					     AGENT_ADULT_AGE);
 			}
 		}
 	}
 }
 
-void init_simulate()
+struct world *create_world(unsigned long long seed, int options)
 {
-	place_random_lake();
-	place_random_road();
-	place_houses_along_road();
-	population_graph = (struct graph){
+	struct world *w = calloc(1, sizeof(*w));
+	if (!w) {
+		SDL_Log("Failed to allocate world");
+		return 0;
+	}
+	w->options = options;
+	init_edit_queue(&w->edits);
+	init_summary(&w->summary);
+	for (int i = 0; i < EVENT_WHEEL_SIZE; i++) {
+		w->house_wheel[i] = -1;
+		w->lot_wheel[i] = -1;
+	}
+	for (int i = 0; i < GRID_HEIGHT * GRID_WIDTH; i++) {
+		w->lot_due[i] = -1;
+	}
+	// xorshift must never be seeded with zero.
+	w->rng = seed * 0x9E3779B97F4A7C15ULL + 1;
+	if (init_fields(&w->fields, options & WORLD_PARALLEL_FIELDS) < 0) {
+		destroy_world(w);
+		return 0;
+	}
+	if ((options & WORLD_AGENTS) &&
+	    init_agents(&w->agents, MAX_RESIDENTS, MAX_BUILDINGS) < 0) {
+		destroy_world(w);
+		return 0;
+	}
+	if (!(options & WORLD_EMPTY)) {
+		place_random_lake(w);
+		place_random_road(w);
+		place_random_zones(w);
+		place_houses_along_road(w);
+	}
+	w->population_graph = (struct graph){
 		.x = 10,
 		.y = 100,
 		.w = 300,
 		.h = 100,
-		.values = population_samples,
+		.values = w->population_samples,
 		.num_values = 0,
 	};
-	render_push_graph(&population_graph);
+	if (options & WORLD_RENDERED) {
+		render_push_graph(&w->population_graph);
+	}
+	return w;
 }
 
-static void build_new_houses()
+void destroy_world(struct world *w)
 {
-	for (int y = 0; y < GRID_HEIGHT; y++) {
-		for (int x = 0; x < GRID_WIDTH; x++) {
-			if (grid[y][x].type == TILE_GRASS &&
-			    has_neighbouring_road(x, y) && CHANCE(0.0025)) {
-				build_house(x, y);
-			}
+	destroy_agents(&w->agents);
+	destroy_fields(&w->fields);
+	free(w);
+}
+
+static float clamp(float v, float lo, float hi)
+{
+	return v < lo ? lo : v > hi ? hi : v;
+}
+
+// Scales how likely a lot is to grow a house: land value attracts
+// residents, pollution drives them away.
+static float desirability(const struct world *w, int x, int y)
+{
+	float value = field_at(&w->fields, FIELD_LAND_VALUE, x, y);
+	float pollution = field_at(&w->fields, FIELD_POLLUTION, x, y);
+	return clamp(1 + value - 2 * pollution, 0, MAX_DESIRABILITY);
+}
+
+static int is_frontier_lot(const struct world *w, int x, int y)
+{
+	return w->grid[y][x].type == TILE_GRASS &&
+	       has_neighbouring_road(w, x, y);
+}
+
+// The highest develop chance any lot can have, which lots draw their
+// candidate events at.
+static float max_develop_chance()
+{
+	float chance = 0;
+	for (int i = 0; i < TILE_TYPE_COUNT; i++) {
+		chance = fmaxf(chance, tile_rules[i].develop_chance);
+	}
+	return chance * MAX_DESIRABILITY;
+}
+
+static void file_lot(struct world *w, int i)
+{
+	int *slot = &w->lot_wheel[w->lot_due[i] & (EVENT_WHEEL_SIZE - 1)];
+	w->lot_next_due[i] = *slot;
+	*slot = i;
+}
+
+static void schedule_lot(struct world *w, int x, int y)
+{
+	int i = y * GRID_WIDTH + x;
+	if (w->lot_due[i] >= 0 || !is_frontier_lot(w, x, y)) {
+		return;
+	}
+	w->lot_due[i] = w->tick + geometric_delay(w, max_develop_chance());
+	file_lot(w, i);
+}
+
+// A tile changing can only move itself and its neighbours onto the
+// frontier. Lots that leave it are dropped when their event comes up.
+static void update_frontier(struct world *w, int x, int y)
+{
+	static const struct { int dx, dy; } deltas[] = {
+		{ 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
+	};
+	int num_deltas = sizeof(deltas)/sizeof(*deltas);
+	for (int i = 0; i < num_deltas; i++) {
+		int x1 = x + deltas[i].dx;
+		int y1 = y + deltas[i].dy;
+		if (in_grid(x1, y1)) {
+			schedule_lot(w, x1, y1);
 		}
 	}
 }
 
-static void update_graphs()
+// Candidate events come at the highest possible rate and are kept in
+// proportion to the lot's own chance, which may have changed since the
+// event was drawn.
+static void develop_lot(struct world *w, int x, int y)
 {
+	if (!is_frontier_lot(w, x, y)) {
+		return;
+	}
+	enum tile_type type = zone_tiles[w->grid[y][x].zone];
+	float chance = tile_rules[type].develop_chance;
+	if (type == TILE_HOUSE) {
+		chance *= desirability(w, x, y);
+	}
+	if (CHANCE(w, chance / max_develop_chance())) {
+		build_tile(w, x, y, type);
+	} else {
+		schedule_lot(w, x, y);
+	}
+}
+
+/*
+ * Only lots on the frontier can develop, and like houses they wait on a
+ * timing wheel, so a tick costs time in proportion to the lots whose
+ * events come up rather than to the size of the map.
+ */
+static void develop_lots(struct world *w)
+{
+	int *slot = &w->lot_wheel[w->tick & (EVENT_WHEEL_SIZE - 1)];
+	int i = *slot;
+	*slot = -1;
+	while (i >= 0) {
+		int next = w->lot_next_due[i];
+		if (w->lot_due[i] != w->tick) {
+			file_lot(w, i);
+		} else {
+			w->lot_due[i] = -1;
+			develop_lot(w, i % GRID_WIDTH, i / GRID_WIDTH);
+		}
+		i = next;
+	}
+}
+
+static void update_graphs(struct world *w)
+{
+	if (!(w->options & WORLD_RENDERED)) {
+		return;
+	}
 	render_pop_graph();
-	population_graph.num_values = num_population_samples;
-	render_push_graph(&population_graph);
+	w->population_graph.num_values = w->num_population_samples;
+	render_push_graph(&w->population_graph);
 }
 
-static void compress_population_samples()
+static void compress_population_samples(struct world *w)
 {
-	for (int i = 0; i < num_population_samples / 2; i++) {
-		population_samples[i] = (population_samples[2*i] +
-					 population_samples[2*i + 1]) / 2;
+	float *samples = w->population_samples;
+	for (int i = 0; i < w->num_population_samples / 2; i++) {
+		samples[i] = (samples[2*i] + samples[2*i + 1]) / 2;
 	}
-	num_population_samples /= 2;
+	w->num_population_samples /= 2;
 }
 
-void simulate()
+static void run_house_event(struct world *w, int i, int *moving_out)
 {
-	int moving_out = 0;
-	population = 0;
-	for (int i = 0; i < num_houses; i++) {
-		struct house *h = &houses[i];
-		if (h->adults < 2 && moving_out > 0) {
-			h->adults++;
-			moving_out--;
-		}
-		if (h->children > 0 && CHANCE(0.01)) {
+	struct house *h = &w->houses[i];
+	if (CHANCE(w, LEAVE_CHANCE / HOUSE_EVENT_CHANCE)) {
+		if (h->children > 0) {
 			h->children--;
-			moving_out++;
+			w->population--;
+			(*moving_out)++;
+			agents_leave(&w->agents, i);
+		}
+		return;
+	}
+	float pollution = field_at(&w->fields, FIELD_POLLUTION,
+				   h->tile % GRID_WIDTH, h->tile / GRID_WIDTH);
+	if (h->adults == 2 && h->children < 2 &&
+	    CHANCE(w, 1 - clamp(pollution, 0, 1))) {
+		h->children++;
+		w->population++;
+		agents_spawn(&w->agents, i, AGENT_CHILD, 0);
+	}
+}
+
+static void run_due_houses(struct world *w, int *moving_out)
+{
+	int *slot = &w->house_wheel[w->tick & (EVENT_WHEEL_SIZE - 1)];
+	int i = *slot;
+	*slot = -1;
+	while (i >= 0) {
+		struct house *h = &w->houses[i];
+		int next = h->next_due;
+		if (h->due != w->tick) {
+			file_house(w, i);
+		} else {
+			h->due = -1;
+			run_house_event(w, i, moving_out);
+			house_changed(w, i);
+		}
+		i = next;
+	}
+}
+
+// Children who moved out settle in vacant houses; the rest leave the city.
+static void settle_migrants(struct world *w, int moving_out)
+{
+	while (moving_out > 0 && w->num_vacancies > 0) {
+		int i = w->vacancies[w->num_vacancies - 1];
+		w->houses[i].adults++;
+		w->num_adults++;
+		w->population++;
+		moving_out--;
+		agents_arrive(&w->agents, i);
+		house_changed(w, i);
+	}
+	w->emigration = moving_out;
+	agents_emigrate(&w->agents);
+}
+
+static void update_houses(struct world *w)
+{
+	int moving_out = 0;
+	run_due_houses(w, &moving_out);
+	settle_migrants(w, moving_out);
+}
+
+static void update_workplaces(struct world *w, enum tile_type type)
+{
+	const struct tile_rules *rules = &tile_rules[type];
+	struct workplace_store *store = &w->workplaces[rules->workplace];
+	for (int i = 0; i < store->count; i++) {
+		struct workplace *p = &store->items[i];
+		if (p->workers < rules->jobs &&
+		    w->employment < w->num_adults &&
+		    CHANCE(w, rules->hire_chance)) {
+			p->workers++;
+			w->employment++;
+			agents_employ(&w->agents, p->tile);
+		}
+	}
+}
+
+static void update_commercials(struct world *w)
+{
+	update_workplaces(w, TILE_COMMERCIAL);
+}
+
+static void update_industries(struct world *w)
+{
+	update_workplaces(w, TILE_INDUSTRIAL);
+}
+
+static void update_services(struct world *w)
+{
+	update_workplaces(w, TILE_SERVICE);
+}
+
+// Edits only ever develop empty land, so they never have to tear down a
+// building's residents or workers.
+static int apply_edit(struct world *w, const struct edit *e)
+{
+	if (!in_grid(e->x, e->y)) {
+		return -1;
+	}
+	struct tile *t = &w->grid[e->y][e->x];
+	switch (e->type) {
+	case EDIT_ZONE:
+		if (e->value < 0 || e->value >= ZONE_TYPE_COUNT) {
+			return -1;
+		}
+		t->zone = e->value;
+		mark_tile_dirty(w, e->x, e->y);
+		return 0;
+	case EDIT_TILE:
+		if (t->type != TILE_GRASS || e->value < 0 ||
+		    e->value >= TILE_TYPE_COUNT || e->value == TILE_GRASS) {
+			return -1;
+		}
+		if (tile_rules[e->value].build) {
+			build_tile(w, e->x, e->y, e->value);
+		} else {
+			update_tile(w, e->x, e->y, e->value);
+		}
+		return 0;
+	}
+	return -1;
+}
+
+// Applies an edit straight away rather than at the next tick. Only the
+// thread running the world may call this, and only between ticks.
+int simulate_apply_edit(struct world *w, const struct edit *e)
+{
+	if (apply_edit(w, e) < 0) {
+		return -1;
+	}
+	if (w->edit_log) {
+		edit_log_write(w->edit_log, w->tick, e);
+	}
+	return 0;
+}
+
+// Runs at the tick boundary, so every edit queued since the last tick
+// lands before any rule sees the grid and a replay that applies the same
+// edits before the same tick reproduces the run.
+static void apply_edits(struct world *w)
+{
+	struct edit e;
+	while (edit_pop(&w->edits, &e) == 0) {
+		simulate_apply_edit(w, &e);
+	}
+}
+
+// Queues an edit for the next tick. Safe to call from any thread; fails
+// instead of waiting when too many edits are already pending.
+int simulate_edit(struct world *w, const struct edit *e)
+{
+	return edit_push(&w->edits, e);
+}
+
+void simulate(struct world *w)
+{
+	apply_edits(w);
+	for (int type = 0; type < TILE_TYPE_COUNT; type++) {
+		if (tile_rules[type].update) {
+			tile_rules[type].update(w);
+		}
+	}
+	w->sample_clock++;
+	if (w->sample_clock == SAMPLE_FREQUENCY) {
+		w->sample_clock = 0;
+		w->population_samples[w->num_population_samples++] =
+			w->population;
+		if (w->num_population_samples == POPULATION_RETENTION) {
+			compress_population_samples(w);
+		}
+		w->graph_dirty = 1;
+	}
+	update_fields(&w->fields, w->tick);
+	agents_update(&w->agents, w->tick);
+	w->tick++;
+	develop_lots(w);
+}
+
+// Pushes what changed over any number of ticks to the renderer once, so
+// running many ticks per frame costs one graph update.
+void simulate_flush(struct world *w)
+{
+	if (w->graph_dirty) {
+		update_graphs(w);
+		w->graph_dirty = 0;
+	}
+}
+
+static float overlay_value(const struct world *w, enum overlay_type type,
+			   int i, float field_scale)
+{
+	int x = i % GRID_WIDTH;
+	int y = i / GRID_WIDTH;
+	const struct tile *t = &w->grid[y][x];
+	switch (type) {
+	case OVERLAY_POPULATION:
+	case OVERLAY_OCCUPANCY:
+		if (t->type != TILE_HOUSE) {
+			return 0;
+		}
+		const struct house *h = &w->houses[t->index];
+		return type == OVERLAY_POPULATION ?
+			(h->adults + h->children) / 4.0f : h->adults / 2.0f;
+	case OVERLAY_BUILDS:
+		return w->max_build_count ?
+			(float)w->build_counts[i] / w->max_build_count : 0;
+	case OVERLAY_LAND_VALUE:
+		return field_at(&w->fields, FIELD_LAND_VALUE, x, y) *
+			field_scale;
+	case OVERLAY_POLLUTION:
+		return field_at(&w->fields, FIELD_POLLUTION, x, y) *
+			field_scale;
+	case OVERLAY_TRAFFIC:
+		return field_at(&w->fields, FIELD_TRAFFIC, x, y) * field_scale;
+	default:
+		return 0;
+	}
+}
+
+static const enum field_type overlay_fields[OVERLAY_TYPE_COUNT] = {
+	[OVERLAY_LAND_VALUE] = FIELD_LAND_VALUE,
+	[OVERLAY_POLLUTION]  = FIELD_POLLUTION,
+	[OVERLAY_TRAFFIC]    = FIELD_TRAFFIC,
+};
+
+static int is_field_overlay(enum overlay_type type)
+{
+	return type == OVERLAY_LAND_VALUE || type == OVERLAY_POLLUTION ||
+	       type == OVERLAY_TRAFFIC;
+}
+
+/*
+ * Recolours the renderer's overlay for w. Only the tiles marked since the
+ * last call are redone, unless full is set or the overlay is scaled to a
+ * maximum that has moved: a field's after it steps, the build counts'
+ * when a new most-built tile appears. Hidden overlays still drain the
+ * marks, so switching one on has to pass full.
+ */
+void simulate_overlay(struct world *w, enum overlay_type type, int full)
+{
+	render_show_overlay(type != OVERLAY_NONE);
+	// A field only changes when it steps, whatever happens to its tiles.
+	int field = is_field_overlay(type);
+	if (field) {
+		full |= w->fields.steps != w->overlay_field_steps;
+	} else if (type == OVERLAY_BUILDS) {
+		full |= w->max_build_count != w->overlay_max_build_count;
+	}
+	w->overlay_field_steps = w->fields.steps;
+	w->overlay_max_build_count = w->max_build_count;
+	if (type != OVERLAY_NONE && full) {
+		float field_scale = 0;
+		if (field) {
+			float max = field_max(&w->fields, overlay_fields[type]);
+			field_scale = max > 0 ? 1 / max : 0;
 		}
-		if (h->adults == 2 && h->children < 2 && CHANCE(0.01)) {
-			h->children++;
+		for (int i = 0; i < GRID_WIDTH * GRID_HEIGHT; i++) {
+			render_overlay_tile(i % GRID_WIDTH, i / GRID_WIDTH,
+					    overlay_value(w, type, i,
+							  field_scale));
 		}
-		population += h->adults + h->children;
 	}
-	sample_clock++;
-	if (sample_clock == SAMPLE_FREQUENCY) {
-		sample_clock = 0;
-		population_samples[num_population_samples++] = population;
-		if (num_population_samples == POPULATION_RETENTION) {
-			compress_population_samples();
+	int recolour = type != OVERLAY_NONE && !full && !field;
+	for (int n = 0; n < w->num_overlay_tiles; n++) {
+		int i = w->overlay_tiles[n];
+		w->overlay_tile_dirty[i] = 0;
+		if (recolour) {
+			render_overlay_tile(i % GRID_WIDTH, i / GRID_WIDTH,
+					    overlay_value(w, type, i, 0));
 		}
-		update_graphs();
 	}
-	emigration = moving_out;
-	build_new_houses();
+	w->num_overlay_tiles = 0;
 }
@@ -1,10 +1,135 @@
 #ifndef _SIMULATION_H
 #define _SIMULATION_H
 
-extern void init_simulate();
-extern void simulate();
+#include "game.h"
+#include "render.h"
+#include "agents.h"
+#include "field.h"
+#include "edit.h"
+#include "summary.h"
 
-extern int population;
-extern int emigration;
+// Each house holds at most two adults and two children.
+#define MAX_RESIDENTS ((GRID_WIDTH) * (GRID_HEIGHT) * 4)
+#define MAX_BUILDINGS ((GRID_WIDTH) * (GRID_HEIGHT))
+
+#define POPULATION_RETENTION 128
+
+// Shared by houses and lots. Must be a power of two; events further out
+// than this wrap around and are re-filed when their slot comes up.
+#define EVENT_WHEEL_SIZE 1024
+
+enum overlay_type {
+	OVERLAY_NONE,
+	OVERLAY_POPULATION,
+	OVERLAY_OCCUPANCY,
+	OVERLAY_BUILDS,
+	OVERLAY_LAND_VALUE,
+	OVERLAY_POLLUTION,
+	OVERLAY_TRAFFIC,
+	OVERLAY_TYPE_COUNT,
+};
+
+enum workplace_kind {
+	WORKPLACE_COMMERCIAL,
+	WORKPLACE_INDUSTRIAL,
+	WORKPLACE_SERVICE,
+	WORKPLACE_KIND_COUNT,
+};
+
+// Options passed to create_world().
+#define WORLD_RENDERED (1 << 0)
+#define WORLD_AGENTS (1 << 1)
+#define WORLD_PARALLEL_FIELDS (1 << 2)
+#define WORLD_HISTORY (1 << 3)
+// Leaves the map as bare grass instead of generating a random city.
+#define WORLD_EMPTY (1 << 4)
+
+struct house {
+	int tile;
+	int adults;
+	int children;
+	int due;
+	int next_due;
+	int vacancy;
+	// Residents as last counted in the world's summary.
+	int occupants;
+};
+
+struct workplace {
+	int tile;
+	int workers;
+};
+
+struct workplace_store {
+	struct workplace items[MAX_BUILDINGS];
+	int count;
+};
+
+/*
+ * Everything one city needs to tick. Worlds share no mutable state, so
+ * independent worlds may be simulated on different threads; only a world
+ * created with WORLD_RENDERED reports tile changes and graphs to the
+ * renderer.
+ */
+struct world {
+	struct tile grid[GRID_HEIGHT][GRID_WIDTH];
+	struct house houses[MAX_BUILDINGS];
+	int num_houses;
+	int num_adults;
+	int house_wheel[EVENT_WHEEL_SIZE];
+	// The frontier: grass lots next to a road, each waiting on the lot
+	// wheel for its next chance to develop. A due of -1 means the lot is
+	// not on the wheel.
+	int lot_wheel[EVENT_WHEEL_SIZE];
+	int lot_due[GRID_HEIGHT * GRID_WIDTH];
+	int lot_next_due[GRID_HEIGHT * GRID_WIDTH];
+	int vacancies[MAX_BUILDINGS];
+	int num_vacancies;
+	struct workplace_store workplaces[WORKPLACE_KIND_COUNT];
+	unsigned short build_counts[GRID_HEIGHT * GRID_WIDTH];
+	unsigned short max_build_count;
+	int population;
+	int emigration;
+	int employment;
+	int tick;
+	int sample_clock;
+	float population_samples[POPULATION_RETENTION];
+	int num_population_samples;
+	struct graph population_graph;
+	int graph_dirty;
+	unsigned long long rng;
+	int options;
+	struct agents agents;
+	struct fields fields;
+	struct summary summary;
+	struct edit_queue edits;
+	// With WORLD_HISTORY, the tiles and houses changed since the
+	// timeline last took them.
+	int dirty_tiles[GRID_HEIGHT * GRID_WIDTH];
+	int num_dirty_tiles;
+	unsigned char tile_dirty[GRID_HEIGHT * GRID_WIDTH];
+	int dirty_houses[MAX_BUILDINGS];
+	int num_dirty_houses;
+	unsigned char house_dirty[MAX_BUILDINGS];
+	// With WORLD_RENDERED, the tiles whose overlay colour may have
+	// changed since simulate_overlay() last ran, and the scales it last
+	// coloured with.
+	int overlay_tiles[GRID_HEIGHT * GRID_WIDTH];
+	int num_overlay_tiles;
+	unsigned char overlay_tile_dirty[GRID_HEIGHT * GRID_WIDTH];
+	unsigned short overlay_max_build_count;
+	int overlay_field_steps;
+	// When set, every edit applied is appended here with its tick.
+	FILE *edit_log;
+};
+
+extern struct world *create_world(unsigned long long seed, int options);
+extern void destroy_world(struct world *w);
+extern void simulate(struct world *w);
+extern int simulate_edit(struct world *w, const struct edit *e);
+extern int simulate_apply_edit(struct world *w, const struct edit *e);
+extern void simulate_flush(struct world *w);
+extern void simulate_overlay(struct world *w, enum overlay_type type,
+			     int full);
 
 #endif
@@ -0,0 +1,99 @@
+#include <math.h>
+#include <string.h>
+
+#include "summary.h"
+
+#define LOWBIT(I) ((I) & -(I))
+
+// Every tile starts as grass, and node (i, j) of a Fenwick tree covers
+// LOWBIT(i) * LOWBIT(j) tiles.
+void init_summary(struct summary *s)
+{
+	memset(s, 0, sizeof(*s));
+	for (int i = 1; i <= GRID_HEIGHT; i++) {
+		for (int j = 1; j <= GRID_WIDTH; j++) {
+			s->trees[TILE_GRASS][(i - 1) * GRID_WIDTH + j - 1] =
+				LOWBIT(i) * LOWBIT(j);
+		}
+	}
+}
+
+void summary_add(struct summary *s, int channel, int x, int y, int delta)
+{
+	int *tree = s->trees[channel];
+	for (int i = y + 1; i <= GRID_HEIGHT; i += LOWBIT(i)) {
+		for (int j = x + 1; j <= GRID_WIDTH; j += LOWBIT(j)) {
+			tree[(i - 1) * GRID_WIDTH + j - 1] += delta;
+		}
+	}
+}
+
+// Sum over the tiles above and to the left of (x, y), exclusive.
+static int prefix(const int *tree, int x, int y)
+{
+	int sum = 0;
+	for (int i = y; i > 0; i -= LOWBIT(i)) {
+		for (int j = x; j > 0; j -= LOWBIT(j)) {
+			sum += tree[(i - 1) * GRID_WIDTH + j - 1];
+		}
+	}
+	return sum;
+}
+
+static int rect_sum(const int *tree, int x0, int y0, int x1, int y1)
+{
+	return prefix(tree, x1, y1) - prefix(tree, x0, y1) -
+		prefix(tree, x1, y0) + prefix(tree, x0, y0);
+}
+
+static int clip(long long v, int hi)
+{
+	return v < 0 ? 0 : v > hi ? hi : v;
+}
+
+// Corners are taken as long long so that callers can offset them from
+// arbitrary ints without overflowing before they are clipped.
+static void add_rect(const struct summary *s, long long x0, long long y0,
+		     long long x1, long long y1, struct region *r)
+{
+	x0 = clip(x0, GRID_WIDTH);
+	x1 = clip(x1, GRID_WIDTH);
+	y0 = clip(y0, GRID_HEIGHT);
+	y1 = clip(y1, GRID_HEIGHT);
+	if (x0 >= x1 || y0 >= y1) {
+		return;
+	}
+	for (int c = 0; c < TILE_TYPE_COUNT; c++) {
+		r->tiles[c] += rect_sum(s->trees[c], x0, y0, x1, y1);
+	}
+	r->occupants += rect_sum(s->trees[SUMMARY_OCCUPANTS], x0, y0, x1, y1);
+}
+
+// The part of the rectangle outside the grid is ignored.
+void summary_rect(const struct summary *s, int x, int y, int w, int h,
+		  struct region *r)
+{
+	memset(r, 0, sizeof(*r));
+	add_rect(s, x, y, (long long)x + w, (long long)y + h, r);
+}
+
+// Tiles whose centres lie within radius tiles of tile (x, y), summed one
+// row span at a time. Only rows inside the grid are visited, however
+// large the radius.
+void summary_radius(const struct summary *s, int x, int y, int radius,
+		    struct region *r)
+{
+	memset(r, 0, sizeof(*r));
+	long long dy0 = -(long long)radius;
+	long long dy1 = radius;
+	if (dy0 < -(long long)y) {
+		dy0 = -(long long)y;
+	}
+	if (dy1 > GRID_HEIGHT - 1 - (long long)y) {
+		dy1 = GRID_HEIGHT - 1 - (long long)y;
+	}
+	for (long long dy = dy0; dy <= dy1; dy++) {
+		long long half = sqrt((double)radius * radius - dy * dy);
+		add_rect(s, x - half, y + dy, x + half + 1, y + dy + 1, r);
+	}
+}
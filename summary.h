@@ -0,0 +1,35 @@
+#ifndef _SUMMARY_H
+#define _SUMMARY_H
+
+#include "game.h"
+
+// One channel per tile type counts tiles of that type; the last counts
+// residents.
+enum summary_channel {
+	SUMMARY_OCCUPANTS = TILE_TYPE_COUNT,
+	SUMMARY_CHANNEL_COUNT,
+};
+
+/*
+ * A two-dimensional Fenwick tree per channel. Changing a tile and summing
+ * any rectangle both cost O(log W * log H), so region queries stay cheap
+ * however large the map is.
+ */
+struct summary {
+	int trees[SUMMARY_CHANNEL_COUNT][GRID_HEIGHT * GRID_WIDTH];
+};
+
+struct region {
+	int tiles[TILE_TYPE_COUNT];
+	int occupants;
+};
+
+extern void init_summary(struct summary *s);
+extern void summary_add(struct summary *s, int channel, int x, int y,
+			int delta);
+extern void summary_rect(const struct summary *s, int x, int y, int w, int h,
+			 struct region *r);
+extern void summary_radius(const struct summary *s, int x, int y, int radius,
+			   struct region *r);
+
+#endif
@@ -0,0 +1,501 @@
+#include <SDL2/SDL.h>
+
+#include "game.h"
+#include "timeline.h"
+
+struct changed_tile {
+	int index;
+	struct tile tile;
+};
+
+struct changed_house {
+	int index;
+	int tile;
+	int adults;
+	int children;
+};
+
+/*
+ * One tick's changes as copied off the world by the simulation thread,
+ * waiting to be compressed. A keyframe lists every tile and house.
+ */
+struct record {
+	struct record *next;
+	// Bytes allocated, counted against the history's budget while the
+	// record waits.
+	size_t size;
+	int tick;
+	int keyframe;
+	int num_tiles;
+	int num_houses;
+	struct changed_tile *tiles;
+	struct changed_house *houses;
+};
+
+/*
+ * A keyframe followed by the deltas up to the next one. Records are
+ * stored as varints: the tick gap since the previous record, then runs of
+ * identical tiles, then changed houses, each addressed by its gap from
+ * the previous one.
+ */
+struct segment {
+	int first_tick;
+	int last_tick;
+	unsigned char *data;
+	size_t size;
+	size_t capacity;
+};
+
+struct timeline {
+	size_t max_bytes;
+	size_t bytes;
+	int last_keyframe;
+	struct segment *segments;
+	int num_segments;
+	SDL_mutex *lock;
+	SDL_sem *pending;
+	SDL_cond *drained;
+	struct record *head;
+	struct record *tail;
+	size_t queued_bytes;
+	int stopping;
+	SDL_Thread *thread;
+};
+
+static struct timeline timeline = { 0 };
+
+static struct record *new_record(int tick, int keyframe, int num_tiles,
+				 int num_houses)
+{
+	size_t size = sizeof(struct record) +
+		num_tiles * sizeof(struct changed_tile) +
+		num_houses * sizeof(struct changed_house);
+	struct record *r = malloc(size);
+	if (!r) {
+		return 0;
+	}
+	*r = (struct record){
+		.size = size,
+		.tick = tick,
+		.keyframe = keyframe,
+		.num_tiles = num_tiles,
+		.num_houses = num_houses,
+	};
+	r->tiles = (struct changed_tile *)(r + 1);
+	r->houses = (struct changed_house *)(r->tiles + num_tiles);
+	return r;
+}
+
+static void copy_house(struct record *r, int n, const struct world *w,
+		       int i)
+{
+	const struct house *h = &w->houses[i];
+	r->houses[n] = (struct changed_house){
+		.index = i,
+		.tile = h->tile,
+		.adults = h->adults,
+		.children = h->children,
+	};
+}
+
+static struct record *keyframe(const struct world *w)
+{
+	struct record *r = new_record(w->tick, 1, GRID_WIDTH * GRID_HEIGHT,
+				      w->num_houses);
+	if (!r) {
+		return 0;
+	}
+	for (int i = 0; i < GRID_WIDTH * GRID_HEIGHT; i++) {
+		r->tiles[i] = (struct changed_tile){
+			.index = i,
+			.tile = w->grid[i / GRID_WIDTH][i % GRID_WIDTH],
+		};
+	}
+	for (int i = 0; i < w->num_houses; i++) {
+		copy_house(r, i, w, i);
+	}
+	return r;
+}
+
+static struct record *delta(const struct world *w)
+{
+	struct record *r = new_record(w->tick, 0, w->num_dirty_tiles,
+				      w->num_dirty_houses);
+	if (!r) {
+		return 0;
+	}
+	for (int n = 0; n < w->num_dirty_tiles; n++) {
+		int i = w->dirty_tiles[n];
+		r->tiles[n] = (struct changed_tile){
+			.index = i,
+			.tile = w->grid[i / GRID_WIDTH][i % GRID_WIDTH],
+		};
+	}
+	for (int n = 0; n < w->num_dirty_houses; n++) {
+		copy_house(r, n, w, w->dirty_houses[n]);
+	}
+	return r;
+}
+
+static void clear_dirty(struct world *w)
+{
+	for (int n = 0; n < w->num_dirty_tiles; n++) {
+		w->tile_dirty[w->dirty_tiles[n]] = 0;
+	}
+	for (int n = 0; n < w->num_dirty_houses; n++) {
+		w->house_dirty[w->dirty_houses[n]] = 0;
+	}
+	w->num_dirty_tiles = 0;
+	w->num_dirty_houses = 0;
+}
+
+// Called at a tick boundary. Only copies what changed; the encoding is
+// left to the timeline thread. If the records already waiting would push
+// the history past its budget, waits for the thread to catch up first.
+void timeline_record(struct world *w)
+{
+	if (!timeline.thread) {
+		return;
+	}
+	struct record *r = 0;
+	if (timeline.last_keyframe < 0 ||
+	    w->tick - timeline.last_keyframe >= TIMELINE_KEYFRAME_INTERVAL) {
+		r = keyframe(w);
+		timeline.last_keyframe = w->tick;
+	} else if (w->num_dirty_tiles > 0 || w->num_dirty_houses > 0) {
+		r = delta(w);
+	}
+	clear_dirty(w);
+	if (!r) {
+		return;
+	}
+	SDL_LockMutex(timeline.lock);
+	while (timeline.queued_bytes > 0 &&
+	       timeline.queued_bytes + r->size > timeline.max_bytes) {
+		SDL_CondWait(timeline.drained, timeline.lock);
+	}
+	if (timeline.tail) {
+		timeline.tail->next = r;
+	} else {
+		timeline.head = r;
+	}
+	timeline.tail = r;
+	timeline.queued_bytes += r->size;
+	SDL_UnlockMutex(timeline.lock);
+	SDL_SemPost(timeline.pending);
+}
+
+static int reserve(struct segment *s, size_t extra)
+{
+	if (s->size + extra <= s->capacity) {
+		return 0;
+	}
+	size_t capacity = s->capacity ? s->capacity : 4096;
+	while (capacity < s->size + extra) {
+		capacity *= 2;
+	}
+	unsigned char *data = realloc(s->data, capacity);
+	if (!data) {
+		return -1;
+	}
+	timeline.bytes += capacity - s->capacity;
+	s->data = data;
+	s->capacity = capacity;
+	return 0;
+}
+
+static void put_varint(struct segment *s, unsigned int v)
+{
+	while (v >= 0x80) {
+		s->data[s->size++] = v | 0x80;
+		v >>= 7;
+	}
+	s->data[s->size++] = v;
+}
+
+static unsigned int get_varint(const unsigned char **p)
+{
+	unsigned int v = 0;
+	for (int shift = 0;; shift += 7) {
+		unsigned char b = *(*p)++;
+		v |= (unsigned int)(b & 0x7f) << shift;
+		if (!(b & 0x80)) {
+			return v;
+		}
+	}
+}
+
+static int same_tile(const struct tile *a, const struct tile *b)
+{
+	return a->type == b->type && a->zone == b->zone &&
+		a->index == b->index;
+}
+
+static int compare_tiles(const void *a, const void *b)
+{
+	return ((const struct changed_tile *)a)->index -
+		((const struct changed_tile *)b)->index;
+}
+
+static int compare_houses(const void *a, const void *b)
+{
+	return ((const struct changed_house *)a)->index -
+		((const struct changed_house *)b)->index;
+}
+
+static int count_tile_runs(const struct record *r)
+{
+	int num_runs = 0;
+	for (int i = 0; i < r->num_tiles; i++) {
+		if (i == 0 || r->tiles[i].index != r->tiles[i - 1].index + 1 ||
+		    !same_tile(&r->tiles[i].tile, &r->tiles[i - 1].tile)) {
+			num_runs++;
+		}
+	}
+	return num_runs;
+}
+
+// Five bytes covers any varint, and every field of a run or house is one.
+static int encode(struct segment *s, const struct record *r, int prev_tick)
+{
+	int num_runs = count_tile_runs(r);
+	if (reserve(s, 5 * (3 + 5 * num_runs + 4 * r->num_houses)) < 0) {
+		return -1;
+	}
+	put_varint(s, r->tick - prev_tick);
+	put_varint(s, num_runs);
+	int next = 0;
+	for (int i = 0; i < r->num_tiles;) {
+		int start = i++;
+		while (i < r->num_tiles &&
+		       r->tiles[i].index == r->tiles[i - 1].index + 1 &&
+		       same_tile(&r->tiles[i].tile, &r->tiles[start].tile)) {
+			i++;
+		}
+		const struct tile *t = &r->tiles[start].tile;
+		put_varint(s, r->tiles[start].index - next);
+		put_varint(s, i - start);
+		put_varint(s, t->type);
+		put_varint(s, t->zone);
+		put_varint(s, t->index);
+		next = r->tiles[i - 1].index + 1;
+	}
+	put_varint(s, r->num_houses);
+	next = 0;
+	for (int i = 0; i < r->num_houses; i++) {
+		const struct changed_house *h = &r->houses[i];
+		put_varint(s, h->index - next);
+		put_varint(s, h->tile);
+		put_varint(s, h->adults);
+		put_varint(s, h->children);
+		next = h->index + 1;
+	}
+	return 0;
+}
+
+// Records still waiting count against the budget too, since they are
+// about to be stored.
+static void evict()
+{
+	while (timeline.bytes + timeline.queued_bytes > timeline.max_bytes &&
+	       timeline.num_segments > 1) {
+		timeline.bytes -= timeline.segments[0].capacity;
+		free(timeline.segments[0].data);
+		timeline.num_segments--;
+		memmove(timeline.segments, timeline.segments + 1,
+			timeline.num_segments * sizeof(*timeline.segments));
+	}
+}
+
+static int store(const struct record *r)
+{
+	if (r->keyframe) {
+		struct segment *segments = realloc(
+			timeline.segments,
+			(timeline.num_segments + 1) * sizeof(*segments));
+		if (!segments) {
+			return -1;
+		}
+		timeline.segments = segments;
+		segments[timeline.num_segments++] = (struct segment){
+			.first_tick = r->tick,
+			.last_tick = r->tick,
+		};
+	}
+	if (timeline.num_segments == 0) {
+		return -1;
+	}
+	struct segment *s = &timeline.segments[timeline.num_segments - 1];
+	if (encode(s, r, s->last_tick) < 0) {
+		return -1;
+	}
+	s->last_tick = r->tick;
+	evict();
+	return 0;
+}
+
+static int timeline_thread(void *data)
+{
+	for (;;) {
+		SDL_SemWait(timeline.pending);
+		SDL_LockMutex(timeline.lock);
+		struct record *r = timeline.head;
+		if (!r) {
+			SDL_UnlockMutex(timeline.lock);
+			if (timeline.stopping) {
+				return 0;
+			}
+			continue;
+		}
+		timeline.head = r->next;
+		if (!timeline.head) {
+			timeline.tail = 0;
+		}
+		SDL_UnlockMutex(timeline.lock);
+		// Sorting and encoding happen outside the lock; only the
+		// append and eviction need it, against seeks.
+		qsort(r->tiles, r->num_tiles, sizeof(*r->tiles),
+		      compare_tiles);
+		qsort(r->houses, r->num_houses, sizeof(*r->houses),
+		      compare_houses);
+		SDL_LockMutex(timeline.lock);
+		timeline.queued_bytes -= r->size;
+		if (store(r) < 0) {
+			SDL_Log("Failed to store tick %d in the timeline",
+				r->tick);
+		}
+		SDL_CondSignal(timeline.drained);
+		SDL_UnlockMutex(timeline.lock);
+		free(r);
+	}
+}
+
+int init_timeline(size_t max_bytes)
+{
+	timeline = (struct timeline){
+		.max_bytes = max_bytes,
+		.last_keyframe = -1,
+	};
+	timeline.lock = SDL_CreateMutex();
+	timeline.pending = SDL_CreateSemaphore(0);
+	timeline.drained = SDL_CreateCond();
+	if (!timeline.lock || !timeline.pending || !timeline.drained) {
+		SDL_Log("Failed to create timeline locks: %s",
+			SDL_GetError());
+		return -1;
+	}
+	timeline.thread = SDL_CreateThread(timeline_thread, "timeline", 0);
+	if (!timeline.thread) {
+		SDL_Log("Failed to start timeline thread: %s",
+			SDL_GetError());
+		return -1;
+	}
+	return 0;
+}
+
+static const unsigned char *decode(const unsigned char *p, int *tick,
+				   struct world *view)
+{
+	*tick += get_varint(&p);
+	int num_runs = get_varint(&p);
+	int next = 0;
+	for (int i = 0; i < num_runs; i++) {
+		int start = next + get_varint(&p);
+		int length = get_varint(&p);
+		struct tile t;
+		t.type = get_varint(&p);
+		t.zone = get_varint(&p);
+		t.index = get_varint(&p);
+		for (int j = start; j < start + length; j++) {
+			view->grid[j / GRID_WIDTH][j % GRID_WIDTH] = t;
+		}
+		next = start + length;
+	}
+	int num_houses = get_varint(&p);
+	next = 0;
+	for (int i = 0; i < num_houses; i++) {
+		int index = next + get_varint(&p);
+		struct house *h = &view->houses[index];
+		h->tile = get_varint(&p);
+		h->adults = get_varint(&p);
+		h->children = get_varint(&p);
+		if (index >= view->num_houses) {
+			view->num_houses = index + 1;
+		}
+		next = index + 1;
+	}
+	return p;
+}
+
+/*
+ * Rebuilds the tiles and houses as they were at the given tick into view,
+ * from the nearest keyframe before it. Ticks outside the history kept are
+ * clamped to it; returns the tick reconstructed, or -1 if there is no
+ * history yet.
+ */
+int timeline_seek(int tick, struct world *view)
+{
+	SDL_LockMutex(timeline.lock);
+	if (timeline.num_segments == 0) {
+		SDL_UnlockMutex(timeline.lock);
+		return -1;
+	}
+	const struct segment *first = &timeline.segments[0];
+	const struct segment *last =
+		&timeline.segments[timeline.num_segments - 1];
+	if (tick < first->first_tick) {
+		tick = first->first_tick;
+	} else if (tick > last->last_tick) {
+		tick = last->last_tick;
+	}
+	const struct segment *s = last;
+	while (s->first_tick > tick) {
+		s--;
+	}
+	view->num_houses = 0;
+	const unsigned char *p = s->data;
+	const unsigned char *end = s->data + s->size;
+	int at = s->first_tick;
+	p = decode(p, &at, view);
+	while (p < end) {
+		const unsigned char *q = p;
+		int next = at + get_varint(&q);
+		if (next > tick) {
+			break;
+		}
+		p = decode(p, &at, view);
+	}
+	SDL_UnlockMutex(timeline.lock);
+	view->tick = tick;
+	view->population = 0;
+	view->num_adults = 0;
+	for (int i = 0; i < view->num_houses; i++) {
+		view->population += view->houses[i].adults +
+			view->houses[i].children;
+		view->num_adults += view->houses[i].adults;
+	}
+	return tick;
+}
+
+void finish_timeline()
+{
+	if (!timeline.thread) {
+		return;
+	}
+	timeline.stopping = 1;
+	SDL_SemPost(timeline.pending);
+	SDL_WaitThread(timeline.thread, 0);
+	timeline.thread = 0;
+	while (timeline.head) {
+		struct record *r = timeline.head;
+		timeline.head = r->next;
+		free(r);
+	}
+	for (int i = 0; i < timeline.num_segments; i++) {
+		free(timeline.segments[i].data);
+	}
+	free(timeline.segments);
+	SDL_DestroyMutex(timeline.lock);
+	SDL_DestroySemaphore(timeline.pending);
+	SDL_DestroyCond(timeline.drained);
+}
@@ -0,0 +1,25 @@
+#ifndef _TIMELINE_H
+#define _TIMELINE_H
+
+#include <stddef.h>
+
+#include "simulate.h"
+
+// Ticks between full keyframes; seeking replays at most this many deltas.
+#define TIMELINE_KEYFRAME_INTERVAL 256
+
+/*
+ * Keeps the history of one world's tiles and houses so it can be scrubbed
+ * back through. The world must be created with WORLD_HISTORY. Each tick's
+ * changes are handed to a background thread that compresses them. Changes
+ * still waiting count towards max_bytes along with the compressed
+ * history: once the two together outgrow it, the oldest keyframe and its
+ * deltas are dropped, and recording blocks while the waiting changes
+ * alone would exceed it.
+ */
+extern int init_timeline(size_t max_bytes);
+extern void timeline_record(struct world *w);
+extern int timeline_seek(int tick, struct world *view);
+extern void finish_timeline();
+
+#endif